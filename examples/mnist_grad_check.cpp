@@ -143,7 +143,7 @@ void build_grad_model(md::AfBackend& backend){
     graph->set_group(layers[9]);
     auto error = md::binary_cross_entropy_logit(inputs[0], h);
     // Mean loss
-    md::NodeVec loss = {error.sum() / float(args.batch_size)};
+    md::NodeVec loss = {error.sum() / graph->wrap(n)};
     // Get grads
     auto grads = graph->gradient(loss[0], params);
     std::string name = backend.name;
@@ -199,7 +199,7 @@ void build_obj_model(md::AfBackend& backend){
     graph->set_group(layers[9]);
     auto error = md::binary_cross_entropy_logit(inputs[0], h);
     // Mean loss
-    md::NodeVec loss = {error.sum() / float(args.batch_size)};
+    md::NodeVec loss = {error.sum() / graph->wrap(n)};
 
     std::string name = backend.name;
     name += dat::kPathSeparator + graph->name;
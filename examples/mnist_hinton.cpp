@@ -142,7 +142,8 @@ void build_model(){
     graph->set_group(layers[9]);
     auto error = md::binary_cross_entropy_logit(inputs[0], h);
     // Mean loss
-    md::NodeVec loss = {error.sum() / float(args.batch_size)};
+    // The batch size is read from the input on every call, thus it can change without recompiling
+    md::NodeVec loss = {error.sum() / graph->wrap(n)};
     // Get grads
     auto grads = graph->gradient(loss[0], params);
     // Learning rate
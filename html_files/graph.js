@@ -8,6 +8,7 @@ var PrimalNode = function(parent_group, name, node_info) {
     this.collapsed = true;
     this.hidden = true;
     this.display_node = undefined;
+    this.fill = undefined;
     if (parent_group) {
         if (name[0] == '_') {
             parent_group.child_groups.push(this);
@@ -59,7 +60,8 @@ var GraphMorpher = function(svg_tag, min_width, min_height) {
     this.prime_graph.setNode("_root", new PrimalNode(undefined, "_root", undefined));
     this.prime_graph.node("_root").hidden = false;
 
-    this.addGroup = function (full_name) {
+    // The optional fill colors the group by a measurement, which the description may state
+    this.addGroup = function (full_name, fill, description) {
         var names = full_name.split(this.delimiter);
         var node = this.prime_graph.node(names[0]);
         var name_acc = names[0];
@@ -84,6 +86,11 @@ var GraphMorpher = function(svg_tag, min_width, min_height) {
                 node = this.prime_graph.node(name_acc);
             }
         }
+        if (fill !== undefined) {
+            node.fill = fill;
+            node.node_info.style = "fill: " + fill + "; stroke:#454545;";
+            node.node_info.description = full_name + "<br>" + description;
+        }
         return node;
     };
 
@@ -145,7 +152,7 @@ var GraphMorpher = function(svg_tag, min_width, min_height) {
                     this.display_graph.setParent(node.name, node.parent_group.name);
                 }
                 node.display_node = this.display_graph.node(node.name);
-                node.node_info.style = "fill: #E2E2E2; stroke:#454545; font-weight: bold";
+                node.node_info.style = "fill: " + (node.fill || "#E2E2E2") + "; stroke:#454545; font-weight: bold";
             }
 //                console.log(node.child_groups);
             // Make special
@@ -208,7 +215,7 @@ var GraphMorpher = function(svg_tag, min_width, min_height) {
             node.collapsed = true;
             var inEdges = [];
             var outEdges = [];
-            node.node_info.style = "fill: #A1A1A1; stroke:#454545; font-weight: bold";
+            node.node_info.style = "fill: " + (node.fill || "#A1A1A1") + "; stroke:#454545; font-weight: bold";
             //console.log("I", node.node_info.style);
             //this.display_graph.removeNode(node.display_node);
             //this.display_graph.setNode(node.name, node.display_node);
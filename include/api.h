@@ -12,10 +12,14 @@ namespace metadiff{
         using core::AUTO_INFER_AXIS;
         using core::Axes;
         using core::SymInt;
+        using core::SymRange;
+        using core::OperatorCost;
+        using core::MemoryEstimate;
         using core::Shape;
         using core::nodeType;
         using core::dType ;
         using core::errorPolicy;
+        using core::mathPrecision;
         using core::deviceType;
         using core::Device;
         using core::Group;
@@ -27,6 +31,10 @@ namespace metadiff{
 
         using logging::metadiff_sink;
         using dagre::dagre_to_file;
+        using kernels::HostArray;
+        typedef backend::CpuBackend CpuBackend;
+        typedef backend::FunctionSignature FunctionSignature;
+        typedef backend::InterpreterBackend InterpreterBackend;
 #ifdef AFAPI
         typedef backend::ArrayfireBackend AfBackend;
 #endif
@@ -295,7 +303,7 @@ namespace metadiff{
         }
 
         Node trace(Node node) {
-            return node.logdet();
+            return node.trace();
         }
 
         // Index operators
@@ -7,5 +7,7 @@
 
 #include "backends/base.h"
 #include "backends/arrayfire.h"
+#include "backends/interpreter.h"
+#include "backends/cpu.h"
 
 #endif //METADIFF_BACKENDS_H
@@ -33,35 +33,32 @@ namespace metadiff{
                 logger()->debug() << "af_path set to '" + af_path + "', debug flag is " + std::to_string(debug);
             };
 
-            void compile(std::string source_dir, std::string target_dir, std::string graph_name) {
+            ~ArrayfireBackend() {
+                synchronize();
+            }
+
+            void compile(std::string source_dir, std::string target_dir, std::string graph_name,
+                         instructionSet isa, std::string build_flags) {
                 std::string source_path = os::join_paths(source_dir, graph_name + ".cpp");
-                std::string dll_path = os::join_paths(target_dir, graph_name + ".so");
+                std::string dll_path = this->dll_path(target_dir, graph_name, isa);
                 logger()->debug() << "Compiling file " << source_path << " to " << dll_path;
-                std::string log_path = source_path + ".log";
-                std::string command = "MKL_NUM_THREADS=4 g++ -O3 -Wall -shared -fPIC -std=c++11 -laf ";
-                command += "-Werror=return-type -Wno-unused-variable -Wno-narrowing ";
-                command += " -I" + os::join_paths(af_path, "include");
+                std::string log_path = dll_path + ".log";
+                std::string flags = "-O3 -Wall -fPIC -std=c++11 ";
+                flags += isa_flags(isa) + " ";
+                flags += "-Werror=return-type -Wno-unused-variable -Wno-narrowing ";
+                flags += "-I" + os::join_paths(af_path, "include") + " " + build_flags;
+                std::string prelude_dir = this->prelude_dir(source_dir, flags,
+                                                            {os::join_paths(af_path, "include/af/version.h")});
+                std::string command = "MKL_NUM_THREADS=4 g++ -shared -laf " + flags;
+                command += " -I" + prelude_dir;
                 command += " -L" + os::join_paths(af_path, "lib");
                 command += " -o " + dll_path + " " + source_path;
-                command += " > " + log_path + " 2>&1";
-                logger()->debug() << "Compile command: " << command;
-                int response = system(command.c_str());
-                if (response != 0) {
-                    std::ifstream log_file(log_path);
-                    std::string err_msg((std::istreambuf_iterator<char>(log_file)),
-                                        std::istreambuf_iterator<char>());
-                    auto err = CompilationFailed("Bad compilation response: " + std::to_string(response) +
-                                                 ", command output: " + err_msg);
-                    logger()->error() << err.msg;
-                    throw err;
-                }
-                return;
+                execute_command(command, log_path);
             }
 
             func_ptr link(std::string target_dir,
                                     std::string graph_name) {
-                logger()->debug() << os::join_paths(target_dir, graph_name + ".so");
-                return link_dll(os::join_paths(target_dir, graph_name + ".so"), "eval_func");
+                return link_dll(select_dll(target_dir, graph_name), "eval_func");
             }
 
             void generate_source(std::string source_dir,
@@ -71,7 +68,7 @@ namespace metadiff{
                 std::string source_path = os::join_paths(source_dir, graph->name + ".cpp");
                 logger()->trace() << "Generating source file " << source_path;
                 std::ofstream f;
-                f.open(source_path);
+                f.open(os::join_paths(source_dir, prelude_name()));
 
                 // Print disclaimer
                 f << "// Auto generated by Metadiff\n// Please do not edit\n\n";
@@ -81,12 +78,19 @@ namespace metadiff{
                         "#include \"iostream\"\n"
                         "#include \"memory\"\n"
                         "#include <exception>\n"
+                        "#include <chrono>\n"
                         "#include <arrayfire.h>\n";
                 f << "\n";
 
                 // Write the interface to Shared Variables and InputShapeExceptions
                 write_interface(f);
                 write_af_interface(f);
+                f.close();
+
+                // The prelude is included first, so that its precompiled header can be used
+                f.open(source_path);
+                f << "// Auto generated by Metadiff\n// Please do not edit\n\n";
+                f << "#include <" << prelude_name() << ">\n\n";
 
                 // Print a helper function for memory info
 //                f << "void print_mem_info(std::string name){\n"
@@ -100,37 +104,30 @@ namespace metadiff{
 //                        "\treturn;\n"
 //                        "};\n\n";
 
-                // Print the function interface
-                f << "extern \"C\" std::vector<af::array> "
-                        "eval_func(std::vector<af::array>& inputs, "
+                // The values of the shared variables are bound once when linking
+                write_shared_table(f, graph, "af::array", true);
+                write_hyperparameters(f, graph, true);
+                write_profile_table(f, graph, true);
+
+                // Print the function computing a single step
+                f << "static std::vector<af::array> "
+                        "step(std::vector<af::array>& inputs, "
                         "std::vector<SharedPtr>& shared_vars){\n";
-                // Use the gfor
-                f << "\t// Set up automatic broadcasting\n";
-                f << "\taf::gforSet(true);\n";
 
                 // Check all of the required inputs are provided
-                for (size_t i = 0; i < graph->nodes.size(); i++) {
-                    if (graph->nodes[i]->node_type == core::INPUT and
-                        graph->nodes[i]->op->name != "Shared") {
-                        for (size_t j = 0; j <= inputs.size(); j++) {
-                            if (j == inputs.size()) {
-                                auto err = MissingRequiredInput(targets, inputs, graph->nodes[i]);
-                                logger()->error() << err.msg;
-                                throw err;
-                            }
-                            if (inputs[j]->id == i) {
-                                break;
-                            }
-                        }
-                    }
-                }
+                verify_inputs(graph, inputs, targets);
+                write_symbol_bindings(f, inputs);
+
+                // The body is generated first, such that the symbolic shapes it uses are known
+                std::stringstream body;
+                reset_shape_values();
 
                 // An expression table for all nodes
                 std::vector<std::string> expression_table(graph->nodes.size(), "Undefined");
 
                 // Loop over all nodes and calculate their expressions
                 // as well as write anything that is not inlined
-                f << "\n\t// Calculate all of the computation nodes\n";
+                body << "\n\t// Calculate all of the computation nodes\n";
                 for (size_t i = 0; i < graph->nodes.size(); i++) {
                     std::shared_ptr<NodeInternal> node = graph->nodes[i];
 
@@ -139,39 +136,55 @@ namespace metadiff{
                         expression_table[i] = expression;
                     } else {
                         if (debug) {
-                            f << "\tstd::cout << \"Calculating node '" << i << "'\" << std::endl;\n";
+                            body << "\tstd::cout << \"Calculating node '" << i << "'\" << std::endl;\n";
+                        }
+                        if (profile) {
+                            // Work pending from before, like the updates of the previous step, is not measured
+                            body << "\taf::sync();\n";
+                            body << "\tauto profile_start_" << i << " = std::chrono::steady_clock::now();\n";
                         }
 
                         // TODO this should be properly done for all scalar types
                         // The code generated is af::array node_index = <expression>;
                         if (graph->nodes[i]->node_type == core::CONSTANT and Node(graph->nodes[i]).is_scalar()) {
-                            f << "\tfloat ";
+                            body << "\tfloat ";
                         }
                         else {
-                            f << "\taf::array ";
+                            body << "\taf::array ";
                         }
-                        f << "node_" << i << " = " << expression << ";\n";
+                        body << "node_" << i << " = " << expression << ";\n";
                         expression_table[i] = "node_" + std::to_string(i);
 
+                        // The computation is launched lazily, thus the device must finish it before the timer
+                        if (profile and graph->nodes[i]->node_type == core::CONSTANT and
+                            Node(graph->nodes[i]).is_scalar()) {
+                            body << "\tprofile_record(" << i << ", profile_start_" << i << ", sizeof(float));\n";
+                        } else if (profile) {
+                            body << "\tnode_" << i << ".eval();\n";
+                            body << "\taf::sync();\n";
+                            body << "\tprofile_record(" << i << ", profile_start_" << i << ", node_" << i
+                                 << ".bytes());\n";
+                        }
+
                         if (debug) {
-                            f << "\tstd::cout << \"Node size:\" << node_" << i << ".dims() << std::endl;\n";
+                            body << "\tstd::cout << \"Node size:\" << node_" << i << ".dims() << std::endl;\n";
                         }
                     }
                 }
 
                 // Update all of the shared_variables
-                f << "\n\t// Update all shared variables\n";
+                body << "\n\t// Update all shared variables\n";
                 for (size_t i = 0; i < graph->updates.size(); i++) {
                     if (debug) {
-                        f << "\tstd::cout << \"Calculating update '" << i << "'\" << std::endl;\n";
+                        body << "\tstd::cout << \"Calculating update '" << i << "'\" << std::endl;\n";
                     }
-                    print_update(f, graph->updates[i], expression_table);
+                    print_update(body, graph->updates[i], expression_table);
                 }
                 for (size_t i = 0; i < graph->temporary_updates.size(); i++) {
                     if (debug) {
-                        f << "\tstd::cout << \"Calculating update '" << i << "'\" << std::endl;\n";
+                        body << "\tstd::cout << \"Calculating update '" << i << "'\" << std::endl;\n";
                     }
-                    print_update(f, graph->temporary_updates[i], expression_table);
+                    print_update(body, graph->temporary_updates[i], expression_table);
                 }
 
                 // Disable the automatic broadcasting
@@ -179,16 +192,51 @@ namespace metadiff{
                 // f << "\taf::gforSet(false);";
 
                 // Write all of the output nodes as the return statement
-                f << "\n\t// Write all of the output nodes in correct order\n";
-                f << "\treturn {";
+                body << "\n\t// Write all of the output nodes in correct order\n";
+                body << "\treturn {";
                 for (size_t i = 0; i < targets.size(); i++) {
                     if (i < targets.size() - 1) {
-                        f << expression_table[targets[i]->id] << ", ";
+                        body << expression_table[targets[i]->id] << ", ";
                     } else {
-                        f << expression_table[targets[i]->id] << "};\n";
+                        body << expression_table[targets[i]->id] << "};\n";
                     }
                 }
-                // Close the function block and the file
+                write_shape_prologue(f);
+                f << body.str();
+                f << "}\n";
+
+                // Print the function interface
+                f << "\nextern \"C\" std::vector<af::array> "
+                        "eval_func(std::vector<af::array>& inputs, "
+                        "std::vector<SharedPtr>& shared_vars){\n";
+                // Use the gfor
+                f << "\t// Set up automatic broadcasting\n";
+                f << "\taf::gforSet(true);\n";
+                f << "\treturn step(inputs, shared_vars);\n";
+                f << "}\n";
+
+                // Print the interface running a step for each batch, with a single host round trip
+                f << "\nextern \"C\" std::vector<af::array> "
+                        "eval_steps(std::vector<std::vector<af::array>>& batches, "
+                        "std::vector<SharedPtr>& shared_vars, bool accumulate){\n";
+                f << "\taf::gforSet(true);\n";
+                f << "\tstd::vector<af::array> outputs;\n";
+                f << "\tstd::vector<af::array> totals;\n";
+                f << "\tfor (size_t i = 0; i < batches.size(); i++) {\n";
+                f << "\t\toutputs = step(batches[i], shared_vars);\n";
+                f << "\t\tfor (size_t k = 0; accumulate and k < outputs.size(); k++) {\n";
+                f << "\t\t\tif (i == 0) {\n";
+                f << "\t\t\t\ttotals.push_back(outputs[k].copy());\n";
+                f << "\t\t\t} else {\n";
+                f << "\t\t\t\ttotals[k] += outputs[k];\n";
+                f << "\t\t\t}\n";
+                f << "\t\t}\n";
+                f << "\t\t// Only launch the kernels of the step, without waiting for them on the host\n";
+                f << "\t\tfor (size_t k = 0; accumulate and k < totals.size(); k++) {\n";
+                f << "\t\t\ttotals[k].eval();\n";
+                f << "\t\t}\n";
+                f << "\t}\n";
+                f << "\treturn accumulate ? totals : outputs;\n";
                 f << "}\n";
                 f.close();
             }
@@ -198,7 +246,7 @@ namespace metadiff{
 
             }
 
-            void print_update(std::ofstream &f, std::pair<Node, Node> graph_update,
+            void print_update(std::ostream &f, std::pair<Node, Node> graph_update,
                               std::vector<std::string> &expression_table) {
                 std::shared_ptr<op::SharedInput> cast_op = std::static_pointer_cast<op::SharedInput>(graph_update.first->op);
                 size_t shared_id = cast_op->var->id;
@@ -291,6 +339,34 @@ namespace metadiff{
             }
 
 
+            /** Binds each symbolic integer to a local variable, from the dimensions of the inputs on every call */
+            void write_symbol_bindings(std::ofstream &f, NodeVec inputs) {
+                f << "\t// Bind all symbolic integers\n";
+                std::vector<bool> bound;
+                for (size_t i = 0; i < inputs.size(); i++) {
+                    for (int j = 0; j < 4; j++) {
+                        size_t variable;
+                        long long coefficient;
+                        if (not symbol_of(inputs[i]->shape[j], variable, coefficient)) {
+                            continue;
+                        }
+                        if (bound.size() <= variable) {
+                            bound.resize(variable + 1, false);
+                        }
+                        if (not bound[variable]) {
+                            f << "\tlong long const " << SymInt::variable(variable).to_string_with_star()
+                              << " = inputs[" << inputs[i]->id << "].dims(" << j << ")";
+                            if (coefficient != 1) {
+                                f << " / " << coefficient;
+                            }
+                            f << ";\n";
+                            bound[variable] = true;
+                        }
+                    }
+                }
+                f << "\n";
+            }
+
             std::string node_expression(Node node, std::vector<std::string> &expression_table) {
                 auto node_in = node;
                 auto op_name = node_in->op->name;
@@ -336,6 +412,13 @@ namespace metadiff{
                     // TODO
                     return "NotImplemented";
                 }
+                if (op_name == "Hyperparameter") {
+                    return "hyperparameters[" +
+                           std::to_string(std::static_pointer_cast<op::Hyperparameter>(node_in->op)->slot) + "]";
+                }
+                if (op_name == "SymInt") {
+                    return "float(" + shape_value(std::static_pointer_cast<op::SymIntWrapper>(node_in->op)->value) + ")";
+                }
 
                 // Base operators
                 if (op_name == "Input") {
@@ -363,7 +446,7 @@ namespace metadiff{
                         std::string expression = "af::tile(" + expression_table[parents[0]->id] + ", ";
                         for (int i = 0; i < 4; i++) {
                             if (node_in->shape[i] != parents[0]->shape[i]) {
-                                expression += node_in->shape[i].to_string_with_star();
+                                expression += shape_value(node_in->shape[i]);
                             } else {
                                 expression += "1";
                             }
@@ -556,7 +639,7 @@ namespace metadiff{
                 if (op_name == "Reshape") {
                     std::string expression = "af::moddims(" + expression_table[parents[0]->id] + ", ";
                     for (int i = 0; i < 4; i++) {
-                        expression += node_in->shape[i].to_string_with_star();
+                        expression += shape_value(node_in->shape[i]);
                         if (i < 3) {
                             expression += ", ";
                         }
@@ -617,7 +700,7 @@ namespace metadiff{
             }
 
 
-            void write_af_interface(std::ofstream &f){
+            void write_af_interface(std::ostream &f){
                 f << "namespace metadiff{\n"
                         "    namespace shared{\n"
                         "        /** A shared variable is a like a static variable, which is synchronized between devices */\n"
@@ -679,7 +762,7 @@ namespace metadiff{
 //            }
 
             std::string shared_value(size_t index){
-                return "get<" + std::to_string(index) + ">(shared_vars)->value";
+                return "(*shared_table[" + std::to_string(index) + "])";
 //                return "std::static_pointer_cast<ArrayFireVariable>(shared_vars[" + std::to_string(index) + "])";
 //                return "get_shared(" + std::to_string(index) + ", shared_vars)->value";
 //                return "shared_vars[" + std::to_string(index) + "]->value";
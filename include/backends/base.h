@@ -12,6 +12,125 @@ namespace metadiff{
     namespace backend {
         using namespace exceptions;
 
+        /** Instruction set extensions, which the generated code can be compiled for */
+        enum instructionSet {
+            /** Baseline x86-64 */
+            GENERIC = 0,
+            /** SSE up to 4.2 */
+            SSE42 = 1,
+            /** AVX2 with FMA */
+            AVX2 = 2,
+            /** AVX-512 F, BW, DQ and VL */
+            AVX512 = 3
+        };
+
+        /** Name used as a suffix of the library compiled for the instruction set */
+        std::string isa_name(instructionSet isa) {
+            switch (isa) {
+                case GENERIC: return "generic";
+                case SSE42: return "sse42";
+                case AVX2: return "avx2";
+                default: return "avx512";
+            }
+        }
+
+        /** The g++ flags for compiling for the instruction set */
+        std::string isa_flags(instructionSet isa) {
+            switch (isa) {
+                case GENERIC: return "";
+                case SSE42: return "-msse4.2 -mpopcnt";
+                case AVX2: return "-msse4.2 -mpopcnt -mavx2 -mfma";
+                default: return "-msse4.2 -mpopcnt -mavx2 -mfma -mavx512f -mavx512bw -mavx512dq -mavx512vl";
+            }
+        }
+
+        /** Checks with cpuid if the instruction set is supported by the CPU we are running on */
+        bool isa_supported(instructionSet isa) {
+            __builtin_cpu_init();
+            switch (isa) {
+                case GENERIC: return true;
+                case SSE42: return __builtin_cpu_supports("sse4.2") and __builtin_cpu_supports("popcnt");
+                case AVX2: return isa_supported(SSE42) and __builtin_cpu_supports("avx2") and
+                                  __builtin_cpu_supports("fma");
+                default: return isa_supported(AVX2) and __builtin_cpu_supports("avx512f") and
+                                __builtin_cpu_supports("avx512bw") and __builtin_cpu_supports("avx512dq") and
+                                __builtin_cpu_supports("avx512vl");
+            }
+        }
+
+        /** The most capable instruction set supported by the CPU we are running on */
+        instructionSet host_isa() {
+            for (int isa = AVX512; isa > GENERIC; isa--) {
+                if (isa_supported(instructionSet(isa))) {
+                    return instructionSet(isa);
+                }
+            }
+            return GENERIC;
+        }
+
+        /** A worker thread running the tasks pushed to it one at a time, in the order they were pushed */
+        class EvalQueue {
+        private:
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<std::function<void()>> tasks;
+            bool running;
+            bool stopping;
+            std::thread worker;
+
+            void run() {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [this]() { return stopping or not tasks.empty(); });
+                        if (tasks.empty()) {
+                            return;
+                        }
+                        task = tasks.front();
+                        tasks.pop_front();
+                        running = true;
+                    }
+                    task();
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        running = false;
+                    }
+                    changed.notify_all();
+                }
+            }
+
+        public:
+            EvalQueue() :
+                    running(false),
+                    stopping(false),
+                    worker([this]() { run(); }) { };
+
+            /** Runs all of the remaining tasks before stopping the worker */
+            ~EvalQueue() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                changed.notify_all();
+                worker.join();
+            }
+
+            void push(std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    tasks.push_back(task);
+                }
+                changed.notify_all();
+            }
+
+            /** Blocks until all of the tasks pushed so far have finished */
+            void wait() {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this]() { return tasks.empty() and not running; });
+            }
+        };
+
         /** Abstract class for a backend, which will generate and link code */
         template<typename T>
         class FunctionBackend {
@@ -25,7 +144,36 @@ namespace metadiff{
 
             /** Handle to the underlying DLL */
             void *dll_handle;
+
+            /** The graph of the currently linked instrumented library, empty when there is none */
+            std::string profiled_graph;
+
+            /** The number of calls to the instrumented library */
+            size_t profiled_steps;
+
+            /**
+             * The worker of eval_async, started by its first call. Its queued calls use the members of the
+             * derived backend, thus every backend must call synchronize() in its destructor.
+             */
+            std::shared_ptr<EvalQueue> eval_queue;
+
+            /** The number of calls which have been measured since the function was linked */
+            size_t profiled_calls;
+
+            /** The end of the last node traced from profile mode, in nanoseconds of the steady clock */
+            long long traced_until;
+
+            /** The distinct composite symbolic integers of the generated code, each computed once by a prologue */
+            std::vector<SymInt> shape_values;
+
+            /** The index of each symbolic integer in shape_values */
+            std::unordered_map<SymInt, size_t> shape_ids;
         public:
+            /**
+             * Guards the linked library, which is dll_handle with its entry points, linked_isa and profiled_graph,
+             * as well as hyperparameter_values, since a tiered CpuBackend links from its compiler thread
+             */
+            std::mutex link_mutex;
 
             /** Path to directory used for logging and storing outputs */
             std::string dir_path;
@@ -37,6 +185,13 @@ namespace metadiff{
             /** The type of the function in the compiled library */
             typedef std::vector<T> (*func_ptr)(std::vector<T> &inputs, std::vector<SharedPtr> &shared);
 
+            /**
+             * The type of the entry point running one step for each batch of inputs, with the updates applied after
+             * each of them. It returns the targets of the last step, or their sum over all steps when accumulating.
+             */
+            typedef std::vector<T> (*steps_ptr)(std::vector<std::vector<T>> &batches,
+                                                std::vector<SharedPtr> &shared, bool accumulate);
+
             /** The list of constant variables
              * TODO Currently this is not used */
             std::vector<T> constant_variables;
@@ -44,21 +199,150 @@ namespace metadiff{
             /** The actual function pointer */
             func_ptr eval_func;
 
+            /** The multi-step entry point of the linked library, null if it has none */
+            steps_ptr steps_func;
+
+            /**
+             * The instruction sets for which a separate library is compiled, by default only the one of the host.
+             * When linking, the best one supported by the CPU is selected, thus listing several of them
+             * makes the same build usable on machines of different generations, at the cost of a compilation
+             * for each of them. A GENERIC library is added to such builds, see build_isas().
+             */
+            std::vector<instructionSet> target_isas;
+
+            /** The instruction set of the currently linked library */
+            instructionSet linked_isa;
+
+            /** The maximum number of compiler processes running at the same time */
+            size_t compile_jobs;
+
+            /** When on, the generated sources are compiled against a cached precompiled header of their prelude */
+            bool use_pch;
+
+            /** Directory in which the precompiled headers are cached, when empty pch in os::cache_dir() is used */
+            std::string pch_dir;
+
+            /**
+             * When positive, the library is first built with instrumentation for profile guided optimization
+             * and after this many calls to eval it is rebuilt with the profile and swapped in
+             */
+            size_t pgo_steps;
+
+            /** Whether the rebuild with the profile also uses link time optimization */
+            bool pgo_lto;
+
+            /** The values given to set_hyperparameter for each slot, set again whenever a library is linked */
+            std::map<size_t, float> hyperparameter_values;
+
+            /** When positive, functions predicted to need more bytes than this at their peak fail to compile */
+            long long memory_limit;
+
+            /** Values of the symbolic integers for which the memory is predicted, missing ones take their likely value */
+            std::vector<long long> memory_bindings;
+
+            /**
+             * When on, the generated code measures the time and the size of the result of every computed node,
+             * synchronizing the device after each of them, thus the function is slower
+             */
+            bool profile;
+
+            /** When positive, the measurements of profile mode are recorded after this many calls */
+            size_t profile_steps;
+
+            /** The graph of the function, which the measurements of profile mode are recorded to */
+            Graph profile_graph;
+
             /** When called you don't need to pass the shared variables */
-            std::vector<T> eval(std::vector<T> &inputs) {
-                return eval_func(inputs, shared::shared_vars);
+            virtual std::vector<T> eval(std::vector<T> &inputs) {
+                trace::Span span("eval", "eval");
+                std::vector<T> outputs = eval_func(inputs, shared::shared_vars);
+                profile_step();
+                return outputs;
+            }
+
+            /**
+             * Enqueues a call to eval on the worker of this function and returns immediately.
+             * The calls run one at a time in the order they were made, thus the updates of the shared variables
+             * are applied in order, while the host prepares the next inputs. The buffers of the inputs must not
+             * be modified until the future is ready, and synchronize() must be called before any direct call
+             * to eval or before the shared variables are accessed. Exceptions are rethrown by the future.
+             * The destructor of each backend synchronizes, before any of its members are destroyed.
+             */
+            std::future<std::vector<T>> eval_async(std::vector<T> inputs) {
+                if (not eval_queue) {
+                    eval_queue = std::make_shared<EvalQueue>();
+                }
+                auto task = std::make_shared<std::packaged_task<std::vector<T>()>>([this, inputs]() mutable {
+                    return this->eval(inputs);
+                });
+                eval_queue->push([task]() { (*task)(); });
+                return task->get_future();
+            }
+
+            /** Blocks until all of the calls enqueued by eval_async have finished */
+            void synchronize() {
+                if (eval_queue) {
+                    eval_queue->wait();
+                }
+            }
+
+            /**
+             * Runs a training step for each batch of inputs inside the compiled library, thus the call overhead
+             * is paid once for all of them. Returns the targets of the last step, or when accumulate is set
+             * their sum over all of the steps.
+             */
+            virtual std::vector<T> eval_steps(std::vector<std::vector<T>> &batches, bool accumulate = false) {
+                if (steps_func == nullptr) {
+                    auto err = CompilationFailed("The linked library has no multi-step entry point");
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+                trace::Span span("eval_steps", "eval");
+                std::vector<T> outputs = steps_func(batches, shared::shared_vars, accumulate);
+                profile_step();
+                return outputs;
             }
 
             FunctionBackend(std::string name, bool debug = false) :
                     name(name),
-                    debug(debug) {
+                    dll_handle(nullptr),
+                    profiled_steps(0),
+                    profiled_calls(0),
+                    traced_until(0),
+                    debug(debug),
+                    eval_func(nullptr),
+                    steps_func(nullptr),
+                    target_isas({host_isa()}),
+                    linked_isa(GENERIC),
+                    compile_jobs(std::max(std::thread::hardware_concurrency(), 1U)),
+                    use_pch(true),
+                    pgo_steps(0),
+                    pgo_lto(false),
+                    memory_limit(0),
+                    profile(false),
+                    profile_steps(0) {
                 dir_path = os::make_temp_dir();
             };
 
             FunctionBackend(std::string name, std::string dir_path, bool debug = false) :
                     name(name),
+                    dll_handle(nullptr),
+                    profiled_steps(0),
+                    profiled_calls(0),
+                    traced_until(0),
                     dir_path(dir_path),
-                    debug(debug) { };
+                    debug(debug),
+                    eval_func(nullptr),
+                    steps_func(nullptr),
+                    target_isas({host_isa()}),
+                    linked_isa(GENERIC),
+                    compile_jobs(std::max(std::thread::hardware_concurrency(), 1U)),
+                    use_pch(true),
+                    pgo_steps(0),
+                    pgo_lto(false),
+                    memory_limit(0),
+                    profile(false),
+                    profile_steps(0) { };
 
             /** Any form of initialization required should be carried out here */
             virtual void initialize() { };
@@ -69,19 +353,68 @@ namespace metadiff{
                                          std::vector<Node> inputs,
                                          std::vector<Node> targets) = 0;
 
-            /** Compiles the source file to a dynamic library */
+            /**
+             * Compiles the source file to a dynamic library for the given instruction set,
+             * with the build_flags added to every compiler command
+             */
             virtual void compile(std::string source_dir,
                                  std::string target_dir,
-                                 std::string graph_name) = 0;
+                                 std::string graph_name,
+                                 instructionSet isa,
+                                 std::string build_flags) = 0;
 
             /** Links all of the compiled files and returns the final
              * EvaluationFunction instance */
             virtual func_ptr link(std::string target_dir,
                                   std::string graph_name) = 0;
 
-            /** Function to open and link the DLL specified */
+            /** Path to the library compiled for the instruction set */
+            std::string dll_path(std::string target_dir, std::string graph_name, instructionSet isa) {
+                return os::join_paths(target_dir, graph_name + "_" + isa_name(isa) + ".so");
+            }
+
+            /**
+             * The instruction sets compiled for, which are the target_isas with a GENERIC fallback when there are
+             * several of them or none is supported by this CPU, thus the build can always be linked
+             */
+            std::vector<instructionSet> build_isas() const {
+                std::vector<instructionSet> isas = target_isas;
+                bool supported = false;
+                for (size_t i = 0; i < isas.size(); i++) {
+                    supported = supported or isa_supported(isas[i]);
+                }
+                if ((isas.size() > 1 or not supported) and
+                    std::find(isas.begin(), isas.end(), GENERIC) == isas.end()) {
+                    isas.push_back(GENERIC);
+                }
+                return isas;
+            }
+
+            /**
+             * Selects the library compiled for the best instruction set supported by the CPU
+             * and records it in linked_isa
+             */
+            std::string select_dll(std::string target_dir, std::string graph_name) {
+                std::vector<instructionSet> isas = build_isas();
+                std::sort(isas.rbegin(), isas.rend());
+                for (size_t i = 0; i < isas.size(); i++) {
+                    std::string path = dll_path(target_dir, graph_name, isas[i]);
+                    if (isa_supported(isas[i]) and os::exists(path)) {
+                        linked_isa = isas[i];
+                        logger()->debug() << "Selected library for " << isa_name(isas[i]);
+                        return path;
+                    }
+                }
+                auto err = CompilationFailed("None of the compiled libraries is supported by this CPU");
+                logger()->error() << err.msg;
+                throw err;
+            }
+
+            /** Function to open and link the DLL specified. The link_mutex must be held. */
             func_ptr link_dll(std::string dll_path, std::string symbol_name) {
                 logger()->debug() << "Linking file " << dll_path;
+                trace::Span span("link_dll", "backend");
+                span.arg("path", dll_path);
                 char *error_msg;
                 dll_handle = dlopen((dll_path).c_str(), RTLD_LAZY);
                 if (!dll_handle) {
@@ -95,19 +428,332 @@ namespace metadiff{
                     logger()->error() << e.msg;
                     throw e;
                 }
+                // Resolve the values of all shared variables once, rather than on every access
+                auto bind_shared = (void (*)(std::vector<SharedPtr> &)) dlsym(dll_handle, "bind_shared");
+                if (bind_shared != nullptr) {
+                    bind_shared(shared::shared_vars);
+                }
+                apply_hyperparameters();
+                steps_func = (steps_ptr) dlsym(dll_handle, "eval_steps");
+                // A missing optional symbol must not be reported by the next lookup
+                dlerror();
                 return func_handle;
             };
 
+            /**
+             * Sets the value of a hyperparameter of the compiled function, used from the next call on.
+             * Calls queued by eval_async must be synchronized first. While a library is being linked on
+             * another thread, the value is applied by the link instead.
+             */
+            virtual void set_hyperparameter(Node node, double value) {
+                if (node->op->name != "Hyperparameter") {
+                    auto err = InvalidArguments(NodeVec{node}, "set_hyperparameter", "The node is not a hyperparameter");
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+                size_t slot = std::static_pointer_cast<op::Hyperparameter>(node->op)->slot;
+                std::lock_guard<std::mutex> lock(link_mutex);
+                hyperparameter_values[slot] = float(value);
+                apply_hyperparameters();
+            }
+
+            /**
+             * Writes the values of all hyperparameters set so far to the table of the linked library.
+             * The link_mutex must be held.
+             */
+            void apply_hyperparameters() {
+                if (dll_handle == nullptr) {
+                    return;
+                }
+                auto set_slot = (void (*)(size_t, float)) dlsym(dll_handle, "set_hyperparameter");
+                if (set_slot == nullptr) {
+                    dlerror();
+                    return;
+                }
+                for (auto it = hyperparameter_values.begin(); it != hyperparameter_values.end(); it++) {
+                    set_slot(it->first, it->second);
+                }
+            }
+
+            /**
+             * Writes the table with the values of the hyperparameters, initialized to those in the graph,
+             * and the function setting them. When define is false only a declaration of the table is written.
+             */
+            void write_hyperparameters(std::ostream &f, Graph graph, bool define) {
+                std::vector<double> values;
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    if (graph->nodes[i]->op->name == "Hyperparameter") {
+                        auto op = std::static_pointer_cast<op::Hyperparameter>(graph->nodes[i]->op);
+                        if (values.size() <= op->slot) {
+                            values.resize(op->slot + 1, 0);
+                        }
+                        values[op->slot] = op->value;
+                    }
+                }
+                size_t size = std::max<size_t>(values.size(), 1);
+                if (not define) {
+                    f << "extern float hyperparameters[" << size << "];\n\n";
+                    return;
+                }
+                f << "float hyperparameters[" << size << "] = {";
+                for (size_t i = 0; i < values.size(); i++) {
+                    std::stringstream value;
+                    value << std::setprecision(9) << values[i];
+                    f << (i > 0 ? ", " : "") << value.str();
+                }
+                f << "};\n\n";
+                f << "extern \"C\" void set_hyperparameter(size_t slot, float value){\n";
+                f << "\thyperparameters[slot] = value;\n";
+                f << "}\n\n";
+            }
+
             /** Closes the opened underlying DLL. Any function calls after this will fail. */
             void close() {
                 dlclose(dll_handle);
             }
 
-            /** Compiles a function from the graph given the inputs, targets and extra updates */
-            void compile_function(Graph graph,
-                                  std::vector<Node> inputs,
-                                  std::vector<Node> targets,
-                                  Updates &updates) {
+            /**
+             * Writes the table of pointers to the values of the shared variables, which the generated code
+             * reads them through, and the bind_shared function filling it, called once by link_dll.
+             * When define is false only a declaration of the table is written.
+             */
+            void write_shared_table(std::ostream &f, Graph graph, std::string value_type, bool define) {
+                std::vector<size_t> ids;
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    if (graph->nodes[i]->op->name == "Shared") {
+                        ids.push_back(std::static_pointer_cast<op::SharedInput>(graph->nodes[i]->op)->var->id);
+                    }
+                }
+                size_t size = ids.size() > 0 ? *std::max_element(ids.begin(), ids.end()) + 1 : 1;
+                if (not define) {
+                    f << "extern " << value_type << " *shared_table[" << size << "];\n\n";
+                    return;
+                }
+                f << value_type << " *shared_table[" << size << "];\n\n";
+                f << "extern \"C\" void bind_shared(std::vector<SharedPtr>& shared_vars){\n";
+                for (size_t i = 0; i < ids.size(); i++) {
+                    f << "\tshared_table[" << ids[i] << "] = &get<" << ids[i] << ">(shared_vars)->value;\n";
+                }
+                f << "}\n\n";
+            }
+
+            /**
+             * Checks if the dimension is a multiple c * x of a single symbolic integer,
+             * in which case x can be bound at runtime by dividing the dimension of an input by c
+             */
+            static bool symbol_of(SymInt const &dim, size_t &variable, long long &coefficient) {
+                if (dim.monomials.size() != 1 or dim.monomials[0].coefficient <= 0 or
+                    dim.monomials[0].powers.size() != 1 or dim.monomials[0].powers[0].second != 1) {
+                    return false;
+                }
+                variable = dim.monomials[0].powers[0].first;
+                coefficient = dim.monomials[0].coefficient;
+                return true;
+            }
+
+            /** Forgets all of the symbolic integers, done before generating each function */
+            void reset_shape_values() {
+                shape_values.clear();
+                shape_ids.clear();
+            }
+
+            /**
+             * The expression of a symbolic integer in the generated code. Constants are written as literals
+             * and symbols by the name of the local they are bound to, while any other polynomial refers
+             * to a local computed once by the prologue, rather than evaluating it again in every use.
+             */
+            std::string shape_value(SymInt const &value) {
+                size_t variable;
+                long long coefficient;
+                if (value.is_constant()) {
+                    return std::to_string(value.constant_value());
+                }
+                if (symbol_of(value, variable, coefficient) and coefficient == 1) {
+                    return value.to_string_with_star();
+                }
+                auto found = shape_ids.find(value);
+                if (found != shape_ids.end()) {
+                    return "shape_" + std::to_string(found->second);
+                }
+                shape_ids[value] = shape_values.size();
+                shape_values.push_back(value);
+                return "shape_" + std::to_string(shape_values.size() - 1);
+            }
+
+            /**
+             * Writes the prologue computing all of the symbolic integers collected by shape_value. It has to
+             * follow the symbol bindings, and be written only once all of the code of the function is generated.
+             */
+            void write_shape_prologue(std::ostream &f) {
+                if (shape_values.size() == 0) {
+                    return;
+                }
+                f << "\n\t// Compute all of the symbolic shapes once\n";
+                for (size_t i = 0; i < shape_values.size(); i++) {
+                    f << "\tlong long const shape_" << i << " = " << shape_values[i].to_string_with_star() << ";\n";
+                }
+            }
+
+            /** Verifies that all of the inputs required for the targets and the updates are provided */
+            void verify_inputs(Graph graph, std::vector<Node> inputs, std::vector<Node> targets) {
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    if (graph->nodes[i]->node_type == core::INPUT and
+                        graph->nodes[i]->op->name != "Shared") {
+                        for (size_t j = 0; j <= inputs.size(); j++) {
+                            if (j == inputs.size()) {
+                                auto err = MissingRequiredInput(targets, inputs, graph->nodes[i]);
+                                logger()->error() << err.msg;
+                                throw err;
+                            }
+                            if (inputs[j]->id == i) {
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            /** Executes the command with its output redirected to the log file, throws if it fails */
+            void execute_command(std::string command, std::string log_path) {
+                command += " > " + log_path + " 2>&1";
+                logger()->debug() << "Compile command: " << command;
+                trace::Span span("g++", "compile");
+                span.arg("command", command);
+                int response = system(command.c_str());
+                if (response != 0) {
+                    std::ifstream log_file(log_path);
+                    std::string err_msg((std::istreambuf_iterator<char>(log_file)),
+                                        std::istreambuf_iterator<char>());
+                    auto err = CompilationFailed("Bad compilation response: " + std::to_string(response) +
+                                                 ", command output: " + err_msg);
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+            }
+
+            /** Name of the header with the includes and interfaces, which every generated source starts with */
+            static std::string prelude_name() {
+                return "metadiff_prelude.h";
+            }
+
+            /** The version of the compiler, which precompiled headers are only valid for */
+            static std::string compiler_version() {
+                // Initialized once, even when several backends compile at the same time
+                static std::string const version = read_compiler_version();
+                return version;
+            }
+
+            /** Runs g++ --version and returns its output */
+            static std::string read_compiler_version() {
+                std::string version;
+                FILE *pipe = popen("g++ --version 2>&1", "r");
+                char buffer[256];
+                while (pipe != nullptr and fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+                    version += buffer;
+                }
+                if (pipe != nullptr) {
+                    pclose(pipe);
+                }
+                return version;
+            }
+
+            /**
+             * Returns the directory from which the prelude in the source directory should be included.
+             * When use_pch is on this is a directory in pch_dir, where the prelude is precompiled once for
+             * every compiler version, set of flags and content of the prelude and of the dependencies given.
+             * Since g++ silently ignores a mismatching precompiled header, any failure here only costs time.
+             */
+            std::string prelude_dir(std::string source_dir, std::string flags, std::vector<std::string> dependencies) {
+                if (not use_pch) {
+                    return source_dir;
+                }
+                std::string prelude = os::read_file(os::join_paths(source_dir, prelude_name()));
+                std::string key = compiler_version() + flags + prelude;
+                for (size_t i = 0; i < dependencies.size(); i++) {
+                    key += os::read_file(dependencies[i]);
+                }
+                std::stringstream hash;
+                hash << std::hex << std::hash<std::string>()(key);
+                std::string cache = pch_dir.size() > 0 ? pch_dir : os::join_paths(os::cache_dir(), "pch");
+                os::create_dir(cache, true);
+                std::string dir = os::join_paths(cache, hash.str());
+                std::string header_path = os::join_paths(dir, prelude_name());
+                if (os::exists(header_path + ".gch")) {
+                    logger()->debug() << "Using precompiled header " << header_path << ".gch";
+                    return dir;
+                }
+                // Everything is built under a unique name and then renamed, so concurrent builds do not clash
+                os::create_dir(dir, true);
+                std::stringstream unique;
+                unique << header_path << "." << getpid() << "." << std::hash<std::thread::id>()(std::this_thread::get_id());
+                std::ofstream f(unique.str() + ".h");
+                f << prelude;
+                f.close();
+                try {
+                    execute_command("g++ " + flags + " -x c++-header -o " + unique.str() + ".gch " + unique.str() + ".h",
+                                    unique.str() + ".log");
+                } catch (CompilationFailed &) {
+                    logger()->warn() << "Failed to precompile " << header_path << ", compiling without it";
+                    return source_dir;
+                }
+                std::rename((unique.str() + ".h").c_str(), header_path.c_str());
+                std::rename((unique.str() + ".gch").c_str(), (header_path + ".gch").c_str());
+                std::rename((unique.str() + ".log").c_str(), (header_path + ".log").c_str());
+                return dir;
+            }
+
+            /**
+             * Executes all of the commands, each with its own log file, on up to compile_jobs threads.
+             * Throws the error of the first failed command after all of them have finished.
+             */
+            void execute_commands(std::vector<std::string> const &commands,
+                                  std::vector<std::string> const &log_paths) {
+                std::atomic<size_t> next(0);
+                std::vector<std::exception_ptr> errors(commands.size());
+                auto worker = [&]() {
+                    for (size_t i = next++; i < commands.size(); i = next++) {
+                        try {
+                            execute_command(commands[i], log_paths[i]);
+                        } catch (...) {
+                            errors[i] = std::current_exception();
+                        }
+                    }
+                };
+                std::vector<std::thread> workers;
+                for (size_t i = 1; i < std::min(compile_jobs, commands.size()); i++) {
+                    workers.push_back(std::thread(worker));
+                }
+                worker();
+                for (size_t i = 0; i < workers.size(); i++) {
+                    workers[i].join();
+                }
+                for (size_t i = 0; i < errors.size(); i++) {
+                    if (errors[i]) {
+                        std::rethrow_exception(errors[i]);
+                    }
+                }
+            }
+
+            /** Throws before anything is compiled if the function is predicted to exceed the memory_limit */
+            void check_memory(Graph graph, std::vector<Node> targets) {
+                if (memory_limit <= 0) {
+                    return;
+                }
+                MemoryEstimate estimate = graph->estimate_memory(targets, memory_bindings);
+                logger()->debug() << estimate.report();
+                if (estimate.peak() > memory_limit) {
+                    graph->clear_temporary_updates();
+                    auto err = MemoryLimitExceeded(memory_limit, estimate.report());
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+            }
+
+            /** Generates the source of the function from the graph given the inputs, targets and extra updates */
+            void generate_function(Graph graph,
+                                   std::vector<Node> inputs,
+                                   std::vector<Node> targets,
+                                   Updates &updates) {
                 logger()->debug() << "Compiling function to " << dir_path;
                 os::create_dir(dir_path, true);
                 // Set path for the source
@@ -116,21 +762,284 @@ namespace metadiff{
 
                 // Generate the source
                 graph->add_temporary_updates(updates);
+                check_memory(graph, targets);
+                profile_graph = graph;
+                trace::Span span("generate_source", "backend");
+                span.arg("graph", graph->name);
                 generate_source(source_dir, graph, inputs, targets);
+                span.finish();
                 graph->clear_temporary_updates();
+            }
 
+            /**
+             * Compiles the generated source once for every instruction set and links the best library as eval_func.
+             * When pgo_steps is positive, only the library which will be linked is built, with instrumentation.
+             * Only the linking holds the link_mutex, thus it can run on another thread than the calls.
+             */
+            void build_function(std::string graph_name) {
+                std::string source_dir = os::join_paths(dir_path, "src");
                 // Set path for the lib
                 std::string target_dir = os::join_paths(dir_path, "lib");
                 os::create_dir(target_dir, true);
 
-                // Compile the source to the lib
-                compile(source_dir, target_dir, graph->name);
+                std::vector<instructionSet> isas = build_isas();
+                std::string build_flags;
+                if (pgo_steps > 0) {
+                    std::sort(isas.rbegin(), isas.rend());
+                    for (size_t i = 0; i < isas.size(); i++) {
+                        if (isa_supported(isas[i])) {
+                            isas = {isas[i]};
+                            break;
+                        }
+                    }
+                    // The profiles are written next to the object files, and old ones would be merged into them
+                    std::vector<std::string> files = os::list_files(target_dir);
+                    for (size_t i = 0; i < files.size(); i++) {
+                        if (files[i].size() > 5 and files[i].substr(files[i].size() - 5) == ".gcda") {
+                            std::remove(files[i].c_str());
+                        }
+                    }
+                    build_flags = "-fprofile-generate -fprofile-update=atomic -DMETADIFF_PGO";
+                }
+
+                // Compile the source to the lib, once for every instruction set
+                for (size_t i = 0; i < isas.size(); i++) {
+                    trace::Span span("compile", "backend");
+                    span.arg("isa", isa_name(isas[i]));
+                    compile(source_dir, target_dir, graph_name, isas[i], build_flags);
+                }
 
                 // Open the DLL
-                eval_func = link(target_dir, graph->name);
+                std::lock_guard<std::mutex> lock(link_mutex);
+                eval_func = link(target_dir, graph_name);
+                profiled_calls = 0;
+                profiled_graph = pgo_steps > 0 ? graph_name : "";
+                profiled_steps = 0;
+            }
+
+            /**
+             * Counts the calls to the linked library. In profile mode the measurements are recorded once
+             * they reach profile_steps, while an instrumented library is rebuilt with the collected profile
+             * once they reach pgo_steps. Returns true if eval_func was replaced.
+             * It is called after each call to the linked library, thus never while another thread links one.
+             */
+            virtual bool profile_step() {
+                if (profile and trace::enabled()) {
+                    trace_nodes();
+                }
+                if (profile and ++profiled_calls == profile_steps) {
+                    record_profile();
+                }
+                if (profiled_graph.size() == 0 or ++profiled_steps < pgo_steps) {
+                    return false;
+                }
+                std::string graph_name = profiled_graph;
+                profiled_graph = "";
+                // The instrumented library stays loaded, as the arrays it returned may still refer to its code
+                auto dump_profile = (void (*)()) dlsym(dll_handle, "metadiff_dump_profile");
+                if (dump_profile == nullptr) {
+                    logger()->warn() << "The library of " << graph_name << " is not instrumented";
+                    return false;
+                }
+                dump_profile();
+                return rebuild_with_profile(graph_name);
+            }
+
+            /**
+             * Rebuilds the library with the profile written by the instrumented one and links it right away,
+             * which blocks the calling thread for the whole compilation. Returns true if eval_func was replaced.
+             */
+            virtual bool rebuild_with_profile(std::string graph_name) {
+                std::string path = build_with_profile(graph_name, linked_isa);
+                if (path.size() == 0) {
+                    return false;
+                }
+                link_with_profile(path);
+                return true;
+            }
+
+            /**
+             * Compiles the library of the graph for the instruction set with the collected profile and returns
+             * its path, or an empty string when the compilation fails and the instrumented library is kept.
+             * Nothing is linked, thus it can run on another thread than the calls.
+             */
+            std::string build_with_profile(std::string graph_name, instructionSet isa) {
+                logger()->debug() << "Rebuilding " << graph_name << " with the profile of " << pgo_steps << " steps";
+                std::string source_dir = os::join_paths(dir_path, "src");
+                std::string target_dir = os::join_paths(dir_path, "lib");
+                // Inconsistencies in the counters of the OpenMP threads are corrected rather than reported
+                std::string build_flags = "-fprofile-use -fprofile-correction -Wno-missing-profile";
+                if (pgo_lto) {
+                    build_flags += " -flto=auto -O3";
+                }
+                try {
+                    trace::Span span("compile", "backend");
+                    span.arg("isa", isa_name(isa));
+                    span.arg("profile", "use");
+                    compile(source_dir, target_dir, graph_name, isa, build_flags);
+                } catch (CompilationFailed &) {
+                    logger()->warn() << "Rebuilding " << graph_name << " with its profile failed";
+                    return "";
+                }
+                // dlopen would return the handle of the already loaded instrumented library for the same path
+                std::string path = dll_path(target_dir, graph_name, isa);
+                std::string optimized_path = path.substr(0, path.size() - 3) + "_pgo.so";
+                std::ifstream source(path, std::ios::binary);
+                std::ofstream destination(optimized_path, std::ios::binary);
+                destination << source.rdbuf();
+                return optimized_path;
+            }
+
+            /** Links the library built by build_with_profile as eval_func */
+            void link_with_profile(std::string path) {
+                std::lock_guard<std::mutex> lock(link_mutex);
+                eval_func = link_dll(path, "eval_func");
+                logger()->info() << "Switched to the library optimized with its profile " << path;
+            }
+
+            /**
+             * Writes the mean measurements of profile mode to the ExecutionData of the nodes, saves them to the
+             * profile_db of the graph, if it has one, and exports them as a table to profile.txt in the dir_path.
+             * Nodes which were never computed keep their earlier measurements.
+             */
+            virtual void record_profile() {
+                std::lock_guard<std::mutex> lock(link_mutex);
+                if (profiled_calls == 0 or not profile_graph or dll_handle == nullptr) {
+                    return;
+                }
+                auto table = (void (*)(double **, long long **, unsigned long long **)) dlsym(dll_handle,
+                                                                                            "profile_table");
+                if (table == nullptr) {
+                    dlerror();
+                    logger()->warn() << "The library of " << profile_graph->name << " was not built in profile mode";
+                    return;
+                }
+                double *times;
+                long long *bytes;
+                unsigned long long *calls;
+                table(&times, &bytes, &calls);
+                for (size_t i = 0; i < profile_graph->nodes.size(); i++) {
+                    if (calls[i] > 0) {
+                        profile_graph->nodes[i]->execution.time = times[i] / calls[i];
+                        profile_graph->nodes[i]->execution.bytes = bytes[i];
+                    }
+                }
+                if (profile_graph->profile_db != "") {
+                    profile_graph->save_profile();
+                }
+                export_profile(profile_graph);
+            }
+
+            /** Records a trace span for each node computed by the linked library in profile mode since the last call */
+            void trace_nodes() {
+                std::lock_guard<std::mutex> lock(link_mutex);
+                if (not profile_graph or dll_handle == nullptr) {
+                    return;
+                }
+                auto spans = (void (*)(long long **, long long **)) dlsym(dll_handle, "profile_spans");
+                if (spans == nullptr) {
+                    dlerror();
+                    return;
+                }
+                long long *starts;
+                long long *ends;
+                spans(&starts, &ends);
+                long long until = traced_until;
+                for (size_t i = 0; i < profile_graph->nodes.size(); i++) {
+                    if (ends[i] > 0 and starts[i] >= traced_until) {
+                        Node node = profile_graph->nodes[i];
+                        std::chrono::steady_clock::time_point start{std::chrono::nanoseconds(starts[i])};
+                        std::chrono::steady_clock::time_point end{std::chrono::nanoseconds(ends[i])};
+                        trace::record(node->op->name + "[" + std::to_string(i) + "]", "node", start, end,
+                                      {{"group", node->group.lock()->full_name}});
+                        until = std::max(until, ends[i]);
+                    }
+                }
+                traced_until = until;
+            }
+
+            /** Writes the measured nodes of the graph to profile.txt in the dir_path, the slowest first */
+            void export_profile(Graph graph) {
+                std::vector<Node> measured;
+                double total = 0;
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    if (graph->nodes[i]->execution.time >= 0) {
+                        measured.push_back(graph->nodes[i]);
+                        total += graph->nodes[i]->execution.time;
+                    }
+                }
+                std::stable_sort(measured.begin(), measured.end(), [](Node const &a, Node const &b) {
+                    return a->execution.time > b->execution.time;
+                });
+                os::create_dir(dir_path, true);
+                std::string path = os::join_paths(dir_path, "profile.txt");
+                std::ofstream f(path);
+                f << std::left << std::setw(8) << "Node" << std::setw(24) << "Operator" << std::setw(32) << "Group"
+                  << std::setw(14) << "Time [us]" << std::setw(10) << "Share [%]" << "Bytes\n";
+                for (size_t i = 0; i < measured.size(); i++) {
+                    double time = measured[i]->execution.time;
+                    f << std::setw(8) << measured[i]->id << std::setw(24) << measured[i]->op->name
+                      << std::setw(32) << measured[i]->group.lock()->full_name
+                      << std::setw(14) << std::fixed << std::setprecision(3) << time * 1e6
+                      << std::setw(10) << std::setprecision(1) << (total > 0 ? 100 * time / total : 0)
+                      << measured[i]->execution.bytes << "\n";
+                }
+                logger()->info() << "Exported the profile of " << graph->name << " to " << path;
+            }
+
+            /**
+             * Writes the measurements of profile mode, indexed by the node id, and the function recording them
+             * after each computed node. When define is false only a declaration of the function is written.
+             * Nothing is written when the profile mode is off, thus the generated code has no overhead.
+             */
+            void write_profile_table(std::ostream &f, Graph graph, bool define) {
+                if (not profile) {
+                    return;
+                }
+                std::string signature = "void profile_record(size_t node, "
+                        "std::chrono::steady_clock::time_point start, long long bytes)";
+                if (not define) {
+                    f << signature << ";\n\n";
+                    return;
+                }
+                size_t size = std::max<size_t>(graph->nodes.size(), 1);
+                f << "double profile_times[" << size << "] = {};\n";
+                f << "long long profile_bytes[" << size << "] = {};\n";
+                f << "unsigned long long profile_calls[" << size << "] = {};\n";
+                f << "// The last computation of each node in nanoseconds of the steady clock, for the trace spans\n";
+                f << "long long profile_starts[" << size << "] = {};\n";
+                f << "long long profile_ends[" << size << "] = {};\n\n";
+                f << signature << "{\n";
+                f << "\tauto end = std::chrono::steady_clock::now();\n";
+                f << "\tprofile_times[node] += std::chrono::duration<double>(end - start).count();\n";
+                f << "\tprofile_bytes[node] = bytes;\n";
+                f << "\tprofile_calls[node]++;\n";
+                f << "\tprofile_starts[node] = std::chrono::duration_cast<std::chrono::nanoseconds>("
+                        "start.time_since_epoch()).count();\n";
+                f << "\tprofile_ends[node] = std::chrono::duration_cast<std::chrono::nanoseconds>("
+                        "end.time_since_epoch()).count();\n";
+                f << "}\n\n";
+                f << "extern \"C\" void profile_spans(long long **starts, long long **ends){\n";
+                f << "\t*starts = profile_starts;\n";
+                f << "\t*ends = profile_ends;\n";
+                f << "}\n\n";
+                f << "extern \"C\" void profile_table(double **times, long long **bytes, unsigned long long **calls){\n";
+                f << "\t*times = profile_times;\n";
+                f << "\t*bytes = profile_bytes;\n";
+                f << "\t*calls = profile_calls;\n";
+                f << "}\n\n";
             }
 
-            void write_interface(std::ofstream &f) {
+            /** Compiles a function from the graph given the inputs, targets and extra updates */
+            virtual void compile_function(Graph graph,
+                                          std::vector<Node> inputs,
+                                          std::vector<Node> targets,
+                                          Updates &updates) {
+                generate_function(graph, inputs, targets, updates);
+                build_function(graph->name);
+            }
+
+            void write_interface(std::ostream &f) {
                 f << "namespace metadiff{\n"
                         "    namespace core {\n"
                         "        enum dType {\n"
@@ -190,7 +1099,15 @@ namespace metadiff{
                         "}\n"
                         "\n"
                         "using metadiff::shared::SharedVariable;\n"
-                        "using metadiff::shared::SharedPtr;\n";
+                        "using metadiff::shared::SharedPtr;\n"
+                        "\n"
+                        "#ifdef METADIFF_PGO\n"
+                        "// Writes the profile of the instrumented library\n"
+                        "extern \"C\" void __gcov_dump(void);\n"
+                        "extern \"C\" __attribute__((weak)) void metadiff_dump_profile() {\n"
+                        "    __gcov_dump();\n"
+                        "}\n"
+                        "#endif\n";
             }
         };
     }
@@ -0,0 +1,1422 @@
+//
+// Created by alex on 14/10/16.
+//
+
+#ifndef AUTODIFF_BACKENDS_CPU_H
+#define AUTODIFF_BACKENDS_CPU_H
+
+namespace metadiff{
+    namespace backend {
+        using namespace exceptions;
+        using kernels::HostArray;
+
+        /** The inputs, targets and updates of one of the functions compiled together by compile_functions */
+        struct FunctionSignature {
+            NodeVec inputs;
+            NodeVec targets;
+            Updates updates;
+        };
+
+        /**
+         * Backend generating plain C++ over HostArray, which needs only g++ with OpenMP.
+         * All elementwise operators are fused into single loops, while the rest
+         * are computed by the kernels in kernels.h.
+         * Every value, including b8 ones, is represented as f32.
+         *
+         * When tiered is set, compile_function returns as soon as the source is generated,
+         * while g++ runs on a background thread. Until the library is linked, eval runs
+         * the function on an InterpreterBackend, after which it switches to the compiled code.
+         * The interpreter supports every operator this backend does, thus any graph compiled here can be tiered.
+         */
+        class CpuBackend : public FunctionBackend<HostArray> {
+        public:
+            /** Path to the include directory of Metadiff, required by the generated code for the kernels */
+            std::string include_path;
+
+            /** When on, the function is interpreted while it is compiled in the background */
+            bool tiered;
+
+            /** Executes the function until the compiled one is ready */
+            InterpreterBackend interpreter;
+
+            /** The compiled function, null until it is linked */
+            std::atomic<func_ptr> native_func;
+
+            /** The thread compiling and linking the library, when tiered */
+            std::thread compiler;
+
+            /** Any exception thrown on the compiler thread */
+            std::exception_ptr compile_error;
+
+            /** The library rebuilt with the profile on the compiler thread, valid once profile_ready is set */
+            std::string profile_library;
+
+            /** Set by the compiler thread when the rebuild with the profile has finished */
+            std::atomic<bool> profile_ready;
+
+            /** The type of the entry point computing the targets into caller provided buffers */
+            typedef void (*into_ptr)(std::vector<HostArray> &inputs, std::vector<SharedPtr> &shared,
+                                     std::vector<HostArray> &outputs);
+
+            /** The compiled entry point computing into the outputs, set whenever native_func is */
+            into_ptr into_func;
+
+            /** The type of the entry point computing only the optional targets which are fetched */
+            typedef std::vector<HostArray> (*masked_ptr)(std::vector<HostArray> &inputs,
+                                                         std::vector<SharedPtr> &shared,
+                                                         std::vector<bool> const &fetch);
+
+            /** The compiled entry point taking a fetch mask, set whenever native_func is */
+            masked_ptr masked_func;
+
+            /** The number of optional targets, which are the last ones of the function compiled last */
+            size_t optional_count;
+
+            /** The number of targets of the function run by eval, the optional ones included */
+            size_t target_count;
+
+            /** The number of optional targets of the function run by eval, which is the size of its fetch masks */
+            size_t fetch_count;
+
+            /**
+             * When on, the arrays of the intermediate nodes are kept between calls in a workspace shared by all
+             * functions of the library, so that their buffers are not allocated again.
+             * The calls must then not run concurrently.
+             */
+            bool share_workspace;
+
+            /** The entry points of the functions compiled by compile_functions, the first one being eval_func */
+            std::vector<func_ptr> function_funcs;
+
+            /** The values of the symbolic integers of each specialized variant, added by specialize() */
+            std::vector<std::vector<std::pair<size_t, long long>>> specializations;
+
+            /** The entry points of the specialized variants of the compiled function */
+            std::vector<func_ptr> variant_funcs;
+
+            /** The input and its dimension from which each symbolic integer is read */
+            std::vector<std::pair<size_t, int>> symbol_sources;
+
+            /** Inputs bound with bind() */
+            std::vector<HostArray> bound_inputs;
+
+            /** Outputs bound with bind() */
+            std::vector<HostArray> bound_outputs;
+
+            CpuBackend(bool debug = false) :
+                    FunctionBackend("Cpu", debug),
+                    tiered(false),
+                    interpreter(this->dir_path, debug),
+                    native_func(nullptr),
+                    profile_ready(false),
+                    into_func(nullptr),
+                    masked_func(nullptr),
+                    optional_count(0),
+                    target_count(0),
+                    fetch_count(0),
+                    share_workspace(false),
+                    unit_size(256),
+                    unit_count(1) {
+                include_path = default_include_path();
+                logger()->debug() << "include_path set to '" + include_path + "', debug flag is " + std::to_string(debug);
+            };
+
+            CpuBackend(std::string dir_path, bool debug = false) :
+                    FunctionBackend("Cpu", dir_path, debug),
+                    tiered(false),
+                    interpreter(dir_path, debug),
+                    native_func(nullptr),
+                    profile_ready(false),
+                    into_func(nullptr),
+                    masked_func(nullptr),
+                    optional_count(0),
+                    target_count(0),
+                    fetch_count(0),
+                    share_workspace(false),
+                    unit_size(256),
+                    unit_count(1) {
+                include_path = default_include_path();
+                logger()->debug() << "include_path set to '" + include_path + "', debug flag is " + std::to_string(debug);
+            };
+
+            CpuBackend(std::string dir_path,
+                       std::string include_path,
+                       bool debug = false) :
+                    FunctionBackend("Cpu", dir_path, debug),
+                    include_path(include_path),
+                    tiered(false),
+                    interpreter(dir_path, debug),
+                    native_func(nullptr),
+                    profile_ready(false),
+                    into_func(nullptr),
+                    masked_func(nullptr),
+                    optional_count(0),
+                    target_count(0),
+                    fetch_count(0),
+                    share_workspace(false),
+                    unit_size(256),
+                    unit_count(1) {
+                logger()->debug() << "include_path set to '" + include_path + "', debug flag is " + std::to_string(debug);
+            };
+
+            ~CpuBackend() {
+                // The queued calls use the interpreter and the compiled function
+                synchronize();
+                if (compiler.joinable()) {
+                    compiler.join();
+                }
+            }
+
+            void compile_function(Graph graph,
+                                  std::vector<Node> inputs,
+                                  std::vector<Node> targets,
+                                  Updates &updates) {
+                if (compiler.joinable()) {
+                    compiler.join();
+                }
+                native_func.store(nullptr);
+                compile_error = nullptr;
+                profile_ready.store(false);
+                function_funcs.clear();
+                target_count = targets.size();
+                fetch_count = optional_count;
+                if (not tiered) {
+                    generate_function(graph, inputs, targets, updates);
+                    generate_variants(graph, inputs, targets, updates);
+                    build_function(graph->name);
+                    swap_function();
+                    return;
+                }
+                interpreter.compile_function(graph, inputs, targets, updates);
+                generate_function(graph, inputs, targets, updates);
+                generate_variants(graph, inputs, targets, updates);
+                std::string graph_name = graph->name;
+                compiler = std::thread([this, graph_name]() {
+                    try {
+                        build_function(graph_name);
+                        swap_function();
+                        logger()->info() << "Switched " << graph_name << " to the compiled function";
+                    } catch (...) {
+                        // The interpreter keeps running the function, the error is rethrown by wait()
+                        compile_error = std::current_exception();
+                    }
+                });
+            }
+
+            /**
+             * Adds a variant of the function specialized to the given values of some of the symbolic integers,
+             * which must be dimensions of the inputs, e.g. specialize({{n, 32}}) for a batch size of 32.
+             * All sizes in the variant are compile time constants, thus the compiler can unroll and hoist.
+             * The variants are built into the same library by the next compile_function and eval
+             * runs the first one matching the dimensions of the inputs, or the generic function if none does.
+             */
+            void specialize(std::vector<std::pair<SymInt, long long>> bindings) {
+                std::vector<std::pair<size_t, long long>> variant;
+                for (size_t i = 0; i < bindings.size(); i++) {
+                    SymInt symbol = bindings[i].first;
+                    if (symbol.monomials.size() != 1 or symbol.monomials[0].coefficient != 1 or
+                        symbol.monomials[0].powers.size() != 1 or symbol.monomials[0].powers[0].second != 1) {
+                        auto err = CompilationFailed("Only a single symbolic integer can be specialized, got " +
+                                                     symbol.to_string());
+                        logger()->error() << err.msg;
+                        throw err;
+                    }
+                    variant.push_back({symbol.monomials[0].powers[0].first, bindings[i].second});
+                }
+                specializations.push_back(variant);
+            }
+
+            /**
+             * Compiles a function which in addition to the targets has the optional targets,
+             * computed only when requested by the fetch mask of eval. The nodes needed only by them,
+             * like the loss of a training function which is logged every few steps, are skipped otherwise.
+             */
+            void compile_function(Graph graph,
+                                  std::vector<Node> inputs,
+                                  std::vector<Node> targets,
+                                  Updates &updates,
+                                  std::vector<Node> optional_targets) {
+                targets.insert(targets.end(), optional_targets.begin(), optional_targets.end());
+                optional_count = optional_targets.size();
+                try {
+                    compile_function(graph, inputs, targets, updates);
+                } catch (...) {
+                    optional_count = 0;
+                    throw;
+                }
+                optional_count = 0;
+            }
+
+            /**
+             * Compiles several functions over the same graph into a single library, which needs only one
+             * g++ run for all of them, e.g. the training, validation and prediction functions of a model.
+             * eval and the rest run the first function, while eval_function runs any of them.
+             * The optimization of the graph should be done once with all of the targets and updates.
+             * The functions are always compiled synchronously, as the interpreter runs a single function.
+             */
+            void compile_functions(Graph graph, std::vector<FunctionSignature> signatures) {
+                if (compiler.joinable()) {
+                    compiler.join();
+                }
+                native_func.store(nullptr);
+                compile_error = nullptr;
+                profile_ready.store(false);
+                if (signatures.size() == 0) {
+                    auto err = CompilationFailed("compile_functions requires at least one signature");
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+                try {
+                    for (size_t i = 0; i < signatures.size(); i++) {
+                        function_prefix = i == 0 ? "" : "f" + std::to_string(i);
+                        generate_function(graph, signatures[i].inputs, signatures[i].targets,
+                                          signatures[i].updates);
+                    }
+                } catch (...) {
+                    function_prefix = "";
+                    throw;
+                }
+                function_prefix = "";
+                target_count = signatures[0].targets.size();
+                fetch_count = 0;
+                function_funcs.resize(signatures.size());
+                build_function(graph->name);
+                swap_function();
+            }
+
+            /** Runs the k-th function compiled by compile_functions */
+            std::vector<HostArray> eval_function(size_t k, std::vector<HostArray> &inputs) {
+                if (k >= function_funcs.size() or function_funcs[k] == nullptr) {
+                    auto err = CompilationFailed("There is no compiled function " + std::to_string(k));
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+                trace::Span span("eval", "eval");
+                span.arg("function", std::to_string(k));
+                std::vector<HostArray> outputs = function_funcs[k](inputs, shared::shared_vars);
+                if (profile_step()) {
+                    swap_function();
+                }
+                return outputs;
+            }
+
+            /**
+             * Computes the targets and only the optional targets for which fetch is true,
+             * with one entry for each of them. The optional targets not fetched are returned empty.
+             */
+            std::vector<HostArray> eval(std::vector<HostArray> &inputs, std::vector<bool> const &fetch) {
+                trace::Span span("eval", "eval");
+                check_count("eval", "fetch mask entries", fetch.size(), fetch_count);
+                if (native_func.load() != nullptr) {
+                    std::vector<HostArray> outputs = masked_func(inputs, shared::shared_vars, fetch);
+                    if (profile_step()) {
+                        swap_function();
+                    }
+                    return outputs;
+                }
+                // The interpreter computes all of the targets
+                std::vector<HostArray> outputs = interpreter.eval(inputs);
+                for (size_t i = 0; i < fetch.size(); i++) {
+                    if (not fetch[i]) {
+                        outputs[outputs.size() - fetch.size() + i] = HostArray();
+                    }
+                }
+                return outputs;
+            }
+
+            /** Runs the compiled function if it is ready, otherwise the interpreter */
+            std::vector<HostArray> eval(std::vector<HostArray> &inputs) {
+                trace::Span span("eval", "eval");
+                func_ptr func = native_func.load();
+                if (func != nullptr) {
+                    func = select_variant(inputs, func);
+                    std::vector<HostArray> outputs = func(inputs, shared::shared_vars);
+                    if (profile_step()) {
+                        swap_function();
+                    }
+                    return outputs;
+                }
+                return interpreter.eval(inputs);
+            }
+
+            /**
+             * Computes the targets directly to the buffers of the outputs, which must have their dimensions.
+             * Host memory of the caller can be passed with HostArray::wrap, thus no array is copied or allocated
+             * for the targets computed by an elementwise loop or a matrix product, while the rest are copied.
+             */
+            void eval_into(std::vector<HostArray> &inputs, std::vector<HostArray> &outputs) {
+                trace::Span span("eval_into", "eval");
+                check_count("eval_into", "outputs", outputs.size(), target_count);
+                if (native_func.load() != nullptr) {
+                    into_func(inputs, shared::shared_vars, outputs);
+                    if (profile_step()) {
+                        swap_function();
+                    }
+                    return;
+                }
+                interpreter.eval_into(inputs, outputs);
+            }
+
+            /** Runs the steps in the compiled function if it is ready, otherwise in the interpreter */
+            std::vector<HostArray> eval_steps(std::vector<std::vector<HostArray>> &batches, bool accumulate = false) {
+                trace::Span span("eval_steps", "eval");
+                if (native_func.load() != nullptr) {
+                    std::vector<HostArray> outputs = steps_func(batches, shared::shared_vars, accumulate);
+                    if (profile_step()) {
+                        swap_function();
+                    }
+                    return outputs;
+                }
+                return interpreter.eval_steps(batches, accumulate);
+            }
+
+            /** Throws InvalidArguments unless the number of entries given to the method is the expected one */
+            void check_count(std::string method, std::string arrays, size_t given, size_t expected) {
+                if (given != expected) {
+                    auto err = InvalidArguments(NodeVec{}, method, "Expected " + std::to_string(expected) + " " +
+                                                                   arrays + ", got " + std::to_string(given));
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+            }
+
+            /** Binds persistent buffers for the inputs and the outputs, used by every call to eval_bound() */
+            void bind(std::vector<HostArray> inputs, std::vector<HostArray> outputs) {
+                bound_inputs = inputs;
+                bound_outputs = outputs;
+            }
+
+            /** Computes the targets from the bound inputs to the bound outputs */
+            void eval_bound() {
+                eval_into(bound_inputs, bound_outputs);
+            }
+
+            /**
+             * Makes eval use the library linked last. The entry points are all looked up before native_func
+             * publishes them, thus eval reads them only after checking it.
+             */
+            void swap_function() {
+                std::lock_guard<std::mutex> lock(link_mutex);
+                into_func = (into_ptr) dlsym(dll_handle, "eval_into");
+                masked_func = (masked_ptr) dlsym(dll_handle, "eval_masked");
+                for (size_t i = 0; i < function_funcs.size(); i++) {
+                    std::string symbol = i == 0 ? "eval_func" : "f" + std::to_string(i) + "_eval_func";
+                    function_funcs[i] = (func_ptr) dlsym(dll_handle, symbol.c_str());
+                }
+                for (size_t i = 0; i < variant_funcs.size(); i++) {
+                    std::string symbol = "s" + std::to_string(i) + "_eval_func";
+                    variant_funcs[i] = (func_ptr) dlsym(dll_handle, symbol.c_str());
+                }
+                // A missing optional symbol must not be reported by the next lookup
+                dlerror();
+                native_func.store(eval_func);
+            }
+
+            /** The first specialized variant matching the dimensions of the inputs, otherwise the generic one */
+            func_ptr select_variant(std::vector<HostArray> &inputs, func_ptr generic) {
+                for (size_t i = 0; i < variant_funcs.size(); i++) {
+                    bool match = variant_funcs[i] != nullptr;
+                    for (size_t j = 0; match and j < specializations[i].size(); j++) {
+                        std::pair<size_t, int> source = symbol_sources[specializations[i][j].first];
+                        match = source.first < inputs.size() and
+                                inputs[source.first].dims[source.second] == specializations[i][j].second;
+                    }
+                    if (match) {
+                        return variant_funcs[i];
+                    }
+                }
+                return generic;
+            }
+
+            /** Generates a function for each of the specializations, after the generic one */
+            void generate_variants(Graph graph, NodeVec inputs, NodeVec targets, Updates &updates) {
+                variant_funcs.assign(specializations.size(), nullptr);
+                symbol_sources.clear();
+                for (size_t i = 0; i < inputs.size(); i++) {
+                    for (int j = 0; j < 4; j++) {
+                        SymInt dim = inputs[i]->shape[j];
+                        if (dim.monomials.size() == 1 and dim.monomials[0].coefficient == 1 and
+                            dim.monomials[0].powers.size() == 1 and dim.monomials[0].powers[0].second == 1) {
+                            size_t variable = dim.monomials[0].powers[0].first;
+                            if (symbol_sources.size() <= variable) {
+                                symbol_sources.resize(variable + 1, {inputs.size(), 0});
+                            }
+                            if (symbol_sources[variable].first == inputs.size()) {
+                                symbol_sources[variable] = {i, j};
+                            }
+                        }
+                    }
+                }
+                for (size_t i = 0; i < specializations.size(); i++) {
+                    for (size_t j = 0; j < specializations[i].size(); j++) {
+                        size_t variable = specializations[i][j].first;
+                        if (variable >= symbol_sources.size() or symbol_sources[variable].first == inputs.size()) {
+                            auto err = CompilationFailed("The specialized symbolic integer " +
+                                                         SymInt::variable(variable).to_string() +
+                                                         " is not a dimension of any input");
+                            logger()->error() << err.msg;
+                            throw err;
+                        }
+                    }
+                }
+                try {
+                    for (size_t i = 0; i < specializations.size(); i++) {
+                        function_prefix = "s" + std::to_string(i);
+                        specialization = specializations[i];
+                        generate_function(graph, inputs, targets, updates);
+                    }
+                } catch (...) {
+                    function_prefix = "";
+                    specialization.clear();
+                    throw;
+                }
+                function_prefix = "";
+                specialization.clear();
+            }
+
+            /**
+             * When tiered, the library is rebuilt with its profile on the compiler thread, while the calls keep
+             * running the instrumented one until profile_step links the new library
+             */
+            bool rebuild_with_profile(std::string graph_name) {
+                if (not tiered) {
+                    return FunctionBackend::rebuild_with_profile(graph_name);
+                }
+                if (compiler.joinable()) {
+                    compiler.join();
+                }
+                instructionSet isa = linked_isa;
+                compiler = std::thread([this, graph_name, isa]() {
+                    try {
+                        profile_library = build_with_profile(graph_name, isa);
+                    } catch (...) {
+                        compile_error = std::current_exception();
+                    }
+                    profile_ready.store(true);
+                });
+                return false;
+            }
+
+            /** Also links the library rebuilt with the profile on the compiler thread, once it is ready */
+            bool profile_step() {
+                bool replaced = FunctionBackend::profile_step();
+                if (profile_ready.exchange(false)) {
+                    if (compiler.joinable()) {
+                        compiler.join();
+                    }
+                    if (profile_library.size() > 0) {
+                        link_with_profile(profile_library);
+                        replaced = true;
+                    }
+                }
+                return replaced;
+            }
+
+            /** Sets the hyperparameter for both the compiled function and the interpreter */
+            void set_hyperparameter(Node node, double value) {
+                FunctionBackend::set_hyperparameter(node, value);
+                interpreter.set_hyperparameter(node, value);
+            }
+
+            /** Whether eval already runs the compiled function */
+            bool is_compiled() const {
+                return native_func.load() != nullptr;
+            }
+
+            /** Blocks until the background compilation finishes, rethrowing any error from it */
+            void wait() {
+                if (compiler.joinable()) {
+                    compiler.join();
+                }
+                if (compile_error) {
+                    std::rethrow_exception(compile_error);
+                }
+            }
+
+            /** Uses METADIFF_PATH if set, otherwise the include directory containing this file */
+            static std::string default_include_path() {
+                if (getenv("METADIFF_PATH")) {
+                    return os::join_paths(getenv("METADIFF_PATH"), "include");
+                }
+                std::string path = __FILE__;
+                return path.substr(0, path.rfind("/backends/"));
+            }
+
+            /** The maximum number of nodes computed in a single translation unit */
+            size_t unit_size;
+
+            /** The number of translation units, besides the driver, of the last generated function */
+            size_t unit_count;
+
+            /** Path to the source of a translation unit, where the driver is the one with index unit_count */
+            std::string unit_path(std::string source_dir, std::string graph_name, size_t unit) {
+                if (unit == unit_count) {
+                    return os::join_paths(source_dir, graph_name + ".cpp");
+                }
+                return os::join_paths(source_dir, graph_name + "_" + std::to_string(unit) + ".cpp");
+            }
+
+            /** The sources of all translation units of the library, the drivers included */
+            std::vector<std::string> sources;
+
+            /**
+             * Prefix of the entry points and the translation units of the function being generated,
+             * which is empty for the first function of a library
+             */
+            std::string function_prefix;
+
+            /** The name of an entry point of the function being generated */
+            std::string entry_name(std::string entry) {
+                return function_prefix.size() == 0 ? entry : function_prefix + "_" + entry;
+            }
+
+            /** The values of the symbolic integers of the function being generated, empty for a generic one */
+            std::vector<std::pair<size_t, long long>> specialization;
+
+            /** Declares the nodes, which are either a new vector or the workspace shared by all calls */
+            void write_workspace(std::ostream &f, Graph graph) {
+                if (share_workspace) {
+                    f << "\tstd::vector<HostArray> &nodes = workspace;\n";
+                } else {
+                    f << "\tstd::vector<HostArray> nodes(" << graph->nodes.size() << ");\n";
+                }
+            }
+
+            /**
+             * Removes the targets from the workspace, as the next call would otherwise overwrite them,
+             * together with the nodes whose buffers the Reshape views among them refer to
+             */
+            void write_detach(std::ostream &f, NodeVec targets) {
+                if (not share_workspace) {
+                    return;
+                }
+                std::vector<size_t> detached;
+                for (size_t i = 0; i < targets.size(); i++) {
+                    for (Node node = targets[i];; node = node->op->get_parents()[0]) {
+                        if (std::find(detached.begin(), detached.end(), node->id) == detached.end()) {
+                            f << "\tnodes[" << node->id << "] = HostArray();\n";
+                            detached.push_back(node->id);
+                        }
+                        if (node->op->name != "Reshape") {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            /** Compiles all translation units concurrently and links them into a single library */
+            void compile(std::string source_dir, std::string target_dir, std::string graph_name,
+                         instructionSet isa, std::string build_flags) {
+                std::string dll_path = this->dll_path(target_dir, graph_name, isa);
+                logger()->debug() << "Compiling " << sources.size() << " translation units to " << dll_path;
+                std::string flags = "-O3 -Wall -fPIC -std=c++11 -fopenmp ";
+                flags += isa_flags(isa) + " ";
+                flags += "-Werror=return-type -Wno-unused-variable -Wno-unused-but-set-variable ";
+                // Allows the selects in kernels::vmath to be vectorized
+                flags += "-fno-trapping-math ";
+                flags += "-I" + include_path + " " + build_flags;
+                // The prelude includes all of the kernels
+                std::vector<std::string> dependencies = os::list_files(os::join_paths(include_path, "kernels"));
+                dependencies.push_back(os::join_paths(include_path, "kernels.h"));
+                std::string prelude_dir = this->prelude_dir(source_dir, flags, dependencies);
+                std::vector<std::string> commands;
+                std::vector<std::string> log_paths;
+                std::string objects;
+                for (size_t i = 0; i < sources.size(); i++) {
+                    std::string object_path = dll_path + "." + std::to_string(i) + ".o";
+                    commands.push_back("g++ " + flags + " -I" + prelude_dir + " -c -o " + object_path + " " +
+                                       sources[i]);
+                    log_paths.push_back(object_path + ".log");
+                    objects += " " + object_path;
+                }
+                execute_commands(commands, log_paths);
+                execute_command("g++ -shared -fopenmp " + build_flags + " -o " + dll_path + objects, dll_path + ".log");
+            }
+
+            func_ptr link(std::string target_dir,
+                          std::string graph_name) {
+                return link_dll(select_dll(target_dir, graph_name), "eval_func");
+            }
+
+            /**
+             * Generates the function as a driver and a number of translation units, each computing
+             * up to unit_size consecutive nodes, which can be compiled concurrently.
+             * All arrays are kept by the driver, and each unit takes references to those it needs.
+             */
+            void generate_source(std::string source_dir,
+                                 Graph graph,
+                                 std::vector<Node> inputs,
+                                 std::vector<Node> targets) {
+                logger()->trace() << "Generating source files for " << graph->name << " in " << source_dir;
+                // Check all of the required inputs are provided
+                verify_inputs(graph, inputs, targets);
+                reset_shape_values();
+                std::vector<Updates> all_updates{graph->updates, graph->temporary_updates};
+                Updates updates;
+                for (size_t i = 0; i < all_updates.size(); i++) {
+                    updates.insert(updates.end(), all_updates[i].begin(), all_updates[i].end());
+                }
+
+                // Decide which nodes need their own buffer
+                std::vector<bool> materialize = plan_materialization(graph, targets, updates);
+                std::vector<std::string> guards = plan_guards(graph, targets, updates);
+
+                // Array holding the value of each node and expression of its element at index 'idx'
+                std::vector<std::string> arrays(graph->nodes.size());
+                std::vector<std::string> elements(graph->nodes.size(), "Undefined");
+                std::vector<long long> positions(graph->nodes.size(), -1);
+                for (size_t i = 0; i < inputs.size(); i++) {
+                    positions[inputs[i]->id] = i;
+                }
+
+                // The code computing each node with its own array
+                std::vector<std::string> statements;
+                std::vector<size_t> computed;
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    Node node = graph->nodes[i];
+                    if (not needed[i]) {
+                        continue;
+                    }
+                    std::string op_name = node->op->name;
+                    std::string scalar_index = node.is_scalar() ? "[0]" : "[idx]";
+                    std::stringstream code;
+                    if (op_name == "Input") {
+                        arrays[i] = "inputs[" + std::to_string(positions[i]) + "]";
+                        elements[i] = arrays[i] + scalar_index;
+                    } else if (op_name == "Shared") {
+                        size_t shared_id = std::static_pointer_cast<op::SharedInput>(node->op)->var->id;
+                        arrays[i] = "shared_" + std::to_string(shared_id);
+                        elements[i] = arrays[i] + scalar_index;
+                    } else if (is_kernel(node)) {
+                        if (not folded[i]) {
+                            code << "\t" << kernel_statement(node, arrays) << "\n";
+                            arrays[i] = "node_" + std::to_string(i);
+                            elements[i] = arrays[i] + scalar_index;
+                        }
+                    } else {
+                        elements[i] = element_expression(node, arrays, elements);
+                        if (materialize[i]) {
+                            code << "\tmetadiff::kernels::prepare(node_" << i << ", "
+                                 << dims_expression(node->shape) << ");\n";
+                            write_loop(code, "node_" + std::to_string(i), elements[i], node->shape);
+                            arrays[i] = "node_" + std::to_string(i);
+                            elements[i] = arrays[i] + scalar_index;
+                        }
+                    }
+                    if (code.str().size() > 0) {
+                        std::string statement = code.str();
+                        if (debug) {
+                            statement = "\tstd::cout << \"Calculating node '" + std::to_string(i) +
+                                        "'\" << std::endl;\n" + statement;
+                        }
+                        if (profile) {
+                            std::string start = "profile_start_" + std::to_string(i);
+                            statement = "\tauto " + start + " = std::chrono::steady_clock::now();\n" + statement +
+                                        "\tprofile_record(" + std::to_string(i) + ", " + start + ", " + arrays[i] +
+                                        ".elements() * sizeof(float));\n";
+                        }
+                        if (guards[i].size() > 0) {
+                            // Indent the statement inside of the guarded block
+                            std::string indented;
+                            for (size_t j = 0; j < statement.size(); j++) {
+                                if (j == 0 or statement[j - 1] == '\n') {
+                                    indented += '\t';
+                                }
+                                indented += statement[j];
+                            }
+                            statement = "\tif (" + guards[i] + ") {\n" + indented + "\t}\n";
+                        }
+                        statements.push_back(statement);
+                        computed.push_back(i);
+                    }
+                }
+
+                // The shared variable whose buffer the array of each node refers to, as the Reshape views do
+                std::vector<long long> aliased(graph->nodes.size(), -1);
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    Node node = graph->nodes[i];
+                    if (node->op->name == "Shared") {
+                        aliased[i] = std::static_pointer_cast<op::SharedInput>(node->op)->var->id;
+                    } else if (node->op->name == "Reshape") {
+                        aliased[i] = aliased[node->op->get_parents()[0]->id];
+                    }
+                }
+
+                // The code updating all of the shared variables, after copying the targets which refer to them
+                std::stringstream update_code;
+                std::vector<size_t> snapshots;
+                for (size_t i = 0; i < targets.size(); i++) {
+                    size_t id = targets[i]->id;
+                    if (aliased[id] < 0 or std::find(snapshots.begin(), snapshots.end(), id) != snapshots.end()) {
+                        continue;
+                    }
+                    for (size_t j = 0; j < updates.size(); j++) {
+                        if (std::static_pointer_cast<op::SharedInput>(updates[j].first->op)->var->id ==
+                            (size_t) aliased[id]) {
+                            update_code << "\tnodes[" << id << "] = " << arrays[id] << ".copy();\n";
+                            arrays[id] = "node_" + std::to_string(id);
+                            snapshots.push_back(id);
+                            break;
+                        }
+                    }
+                }
+                for (size_t i = 0; i < updates.size(); i++) {
+                    if (debug) {
+                        update_code << "\tstd::cout << \"Calculating update '" << i << "'\" << std::endl;\n";
+                    }
+                    size_t shared_id = std::static_pointer_cast<op::SharedInput>(updates[i].first->op)->var->id;
+                    write_loop(update_code, "shared_" + std::to_string(shared_id), elements[updates[i].second->id],
+                               updates[i].first->shape);
+                }
+
+                // Write the prelude and each of the translation units
+                write_prelude(source_dir);
+                std::string name = graph->name;
+                if (function_prefix.size() == 0) {
+                    sources.clear();
+                } else {
+                    name += "_" + function_prefix;
+                }
+                unit_count = std::max<size_t>((statements.size() + unit_size - 1) / unit_size, 1);
+                for (size_t k = 0; k < unit_count; k++) {
+                    size_t end = std::min(statements.size(), (k + 1) * unit_size);
+                    std::ofstream f;
+                    f.open(unit_path(source_dir, name, k));
+                    sources.push_back(unit_path(source_dir, name, k));
+                    write_header(f);
+                    write_shared_table(f, graph, "HostArray", false);
+                    write_hyperparameters(f, graph, false);
+                    write_profile_table(f, graph, false);
+                    f << "void " << name << "_part_" << k << "(std::vector<HostArray>& inputs, "
+                            "std::vector<SharedPtr>& shared_vars, std::vector<HostArray>& nodes, "
+                            "std::vector<bool> const& fetch){\n";
+                    write_bindings(f, graph, inputs, std::vector<size_t>(computed.begin(), computed.begin() + end));
+                    write_shape_prologue(f);
+                    f << "\n\t// Calculate all of the computation nodes\n";
+                    for (size_t i = k * unit_size; i < end; i++) {
+                        f << statements[i];
+                    }
+                    f << "}\n";
+                    f.close();
+                }
+
+                // Write the driver, which calls all of the units and then does the updates
+                std::ofstream f;
+                f.open(unit_path(source_dir, name, unit_count));
+                sources.push_back(unit_path(source_dir, name, unit_count));
+                write_header(f);
+                // The first function of the library defines the shared variable table and the workspace
+                write_shared_table(f, graph, "HostArray", function_prefix.size() == 0);
+                write_hyperparameters(f, graph, function_prefix.size() == 0);
+                write_profile_table(f, graph, function_prefix.size() == 0);
+                if (share_workspace) {
+                    f << (function_prefix.size() == 0 ? "" : "extern ") << "std::vector<HostArray> workspace";
+                    f << (function_prefix.size() == 0 ? "(" + std::to_string(graph->nodes.size()) + ")" : "");
+                    f << ";\n\n";
+                }
+                for (size_t k = 0; k < unit_count; k++) {
+                    f << "void " << name << "_part_" << k << "(std::vector<HostArray>& inputs, "
+                            "std::vector<SharedPtr>& shared_vars, std::vector<HostArray>& nodes, "
+                            "std::vector<bool> const& fetch);\n";
+                }
+                f << "\n// Fetches all of the optional targets\n";
+                f << "static std::vector<bool> const fetch_all(" << optional_count << ", true);\n";
+                f << "\nstatic void compute(std::vector<HostArray>& inputs, std::vector<SharedPtr>& shared_vars, "
+                        "std::vector<HostArray>& nodes, std::vector<bool> const& fetch){\n";
+                for (size_t k = 0; k < unit_count; k++) {
+                    f << "\t" << name << "_part_" << k << "(inputs, shared_vars, nodes, fetch);\n";
+                }
+                write_bindings(f, graph, inputs, computed);
+                write_shape_prologue(f);
+
+                // Update all of the shared_variables
+                f << "\n\t// Update all shared variables\n";
+                f << update_code.str();
+                f << "}\n";
+
+                // The computed nodes among the targets, the copies of the shared variables included
+                std::vector<size_t> computed_targets = snapshots;
+                for (size_t i = 0; i < targets.size(); i++) {
+                    if (std::find(computed.begin(), computed.end(), targets[i]->id) != computed.end() and
+                        std::find(snapshots.begin(), snapshots.end(), targets[i]->id) == snapshots.end()) {
+                        computed_targets.push_back(targets[i]->id);
+                    }
+                }
+
+                // Write the function collecting the targets once the nodes are computed
+                f << "\nstatic std::vector<HostArray> outputs(std::vector<HostArray>& inputs, std::vector<SharedPtr>& "
+                        "shared_vars, std::vector<HostArray>& nodes, std::vector<bool> const& fetch){\n";
+                write_bindings(f, graph, inputs, computed_targets);
+                f << "\n\t// Write all of the output nodes in correct order, the optional ones only if fetched\n";
+                f << "\treturn {";
+                for (size_t i = 0; i < targets.size(); i++) {
+                    if (i + optional_count >= targets.size()) {
+                        f << "fetch[" << i + optional_count - targets.size() << "] ? "
+                          << arrays[targets[i]->id] << " : HostArray()";
+                    } else {
+                        f << arrays[targets[i]->id];
+                    }
+                    if (i < targets.size() - 1) {
+                        f << ", ";
+                    }
+                }
+                f << "};\n";
+                f << "}\n";
+
+                // Write the entry returning newly allocated outputs
+                f << "\nextern \"C\" std::vector<HostArray> " << entry_name("eval_func") << "("
+                        "std::vector<HostArray>& inputs, std::vector<SharedPtr>& shared_vars){\n";
+                write_workspace(f, graph);
+                f << "\tcompute(inputs, shared_vars, nodes, fetch_all);\n";
+                f << "\tstd::vector<HostArray> result = outputs(inputs, shared_vars, nodes, fetch_all);\n";
+                write_detach(f, targets);
+                f << "\treturn result;\n";
+                f << "}\n";
+
+                // Write the entry computing only the optional targets which are fetched
+                f << "\nextern \"C\" std::vector<HostArray> " << entry_name("eval_masked") << "("
+                        "std::vector<HostArray>& inputs, std::vector<SharedPtr>& shared_vars, "
+                        "std::vector<bool> const& fetch){\n";
+                write_workspace(f, graph);
+                f << "\tcompute(inputs, shared_vars, nodes, fetch);\n";
+                f << "\tstd::vector<HostArray> result = outputs(inputs, shared_vars, nodes, fetch);\n";
+                write_detach(f, targets);
+                f << "\treturn result;\n";
+                f << "}\n";
+
+                // Write the entry running a step for each batch, the buffers of the nodes are reused between steps
+                f << "\nextern \"C\" std::vector<HostArray> " << entry_name("eval_steps") << "("
+                        "std::vector<std::vector<HostArray>>& batches, std::vector<SharedPtr>& shared_vars, "
+                        "bool accumulate){\n";
+                write_workspace(f, graph);
+                f << "\tstd::vector<HostArray> totals(" << targets.size() << ");\n";
+                f << "\tfor (size_t step = 0; step < batches.size(); step++) {\n";
+                f << "\t\tcompute(batches[step], shared_vars, nodes, fetch_all);\n";
+                f << "\t\tif (accumulate) {\n";
+                f << "\t\t\tstd::vector<HostArray> step_outputs = outputs(batches[step], shared_vars, nodes, "
+                        "fetch_all);\n";
+                f << "\t\t\tfor (size_t k = 0; k < totals.size(); k++) {\n";
+                f << "\t\t\t\tmetadiff::kernels::accumulate(totals[k], step_outputs[k]);\n";
+                f << "\t\t\t}\n";
+                f << "\t\t}\n";
+                f << "\t}\n";
+                f << "\tstd::vector<HostArray> result = accumulate or batches.size() == 0 ? totals : "
+                        "outputs(batches.back(), shared_vars, nodes, fetch_all);\n";
+                write_detach(f, targets);
+                f << "\treturn result;\n";
+                f << "}\n";
+
+                // Write the entry computing the targets in the buffers of the outputs given
+                f << "\nextern \"C\" void " << entry_name("eval_into") << "("
+                        "std::vector<HostArray>& inputs, std::vector<SharedPtr>& shared_vars, "
+                        "std::vector<HostArray>& outputs){\n";
+                write_workspace(f, graph);
+                f << "\t// Nodes are computed directly in the output buffers when possible\n";
+                for (size_t i = 0; i < targets.size(); i++) {
+                    if (std::find(computed_targets.begin(), computed_targets.end(), targets[i]->id) !=
+                        computed_targets.end()) {
+                        f << "\tnodes[" << targets[i]->id << "] = outputs[" << i << "];\n";
+                    }
+                }
+                f << "\tcompute(inputs, shared_vars, nodes, fetch_all);\n";
+                write_bindings(f, graph, inputs, computed_targets);
+                f << "\n\t// Copy the rest of the output nodes\n";
+                for (size_t i = 0; i < targets.size(); i++) {
+                    f << "\tmetadiff::kernels::assign(outputs[" << i << "], " << arrays[targets[i]->id] << ");\n";
+                }
+                write_detach(f, targets);
+                f << "}\n";
+                f.close();
+            }
+
+            /** Writes the prelude with the includes and the interfaces, which is the same for all functions */
+            void write_prelude(std::string source_dir) {
+                std::ofstream f;
+                f.open(os::join_paths(source_dir, prelude_name()));
+                // Print disclaimer
+                f << "// Auto generated by Metadiff\n// Please do not edit\n\n";
+
+                // Print includes
+                f << "#include \"vector\"\n"
+                        "#include \"iostream\"\n"
+                        "#include \"memory\"\n"
+                        "#include <cmath>\n"
+                        "#include <chrono>\n"
+                        "#include \"kernels.h\"\n";
+                f << "\n";
+
+                // Write the interface to Shared Variables
+                write_interface(f);
+                write_host_interface(f);
+                f.close();
+            }
+
+            /** Writes the start of a translation unit, the prelude must come first to use its precompiled header */
+            void write_header(std::ofstream &f) {
+                f << "// Auto generated by Metadiff\n// Please do not edit\n\n";
+                f << "#include <" << prelude_name() << ">\n\n";
+            }
+
+            /** Binds the symbolic integers, the shared variables and the arrays of the computed nodes */
+            void write_bindings(std::ofstream &f, Graph graph, NodeVec inputs, std::vector<size_t> computed) {
+                write_symbol_bindings(f, inputs);
+                f << "\n\t// References to all shared variables\n";
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    if (graph->nodes[i]->op->name == "Shared") {
+                        size_t shared_id = std::static_pointer_cast<op::SharedInput>(graph->nodes[i]->op)->var->id;
+                        f << "\tHostArray &shared_" << shared_id << " = *shared_table[" << shared_id << "];\n";
+                    }
+                }
+                f << "\n\t// References to the arrays of the computed nodes\n";
+                for (size_t i = 0; i < computed.size(); i++) {
+                    f << "\tHostArray &node_" << computed[i] << " = nodes[" << computed[i] << "];\n";
+                }
+            }
+
+            /** Nodes from which any of the targets or the updates depend on */
+            std::vector<bool> needed;
+
+            /** Transpose nodes which are passed as a flag to all of their MatrixMul children */
+            std::vector<bool> folded;
+
+            /**
+             * Operators computed by a kernel over whole arrays, rather than in an elementwise loop.
+             * Only those implemented by kernel_expression, the rest are not supported by this backend.
+             */
+            bool is_kernel(Node node) {
+                std::string op_name = node->op->name;
+                return op_name == "MatrixMul" or op_name == "Sum" or op_name == "Transpose" or op_name == "Reshape";
+            }
+
+            /**
+             * Marks all elementwise nodes which have to be computed in their own loop.
+             * This is required for all nodes not inlined by the optimizer, for targets,
+             * for the operands of the kernels and for the update values which are
+             * either used elsewhere or read shared variables updated before them.
+             */
+            std::vector<bool> plan_materialization(Graph graph, NodeVec targets, Updates &updates) {
+                size_t n = graph->nodes.size();
+                needed = std::vector<bool>(n, false);
+                folded = std::vector<bool>(n, false);
+                std::vector<bool> materialize(n, false);
+                std::vector<bool> target(n, false);
+                for (size_t i = 0; i < targets.size(); i++) {
+                    needed[targets[i]->id] = true;
+                    materialize[targets[i]->id] = true;
+                    target[targets[i]->id] = true;
+                }
+                for (size_t i = 0; i < updates.size(); i++) {
+                    needed[updates[i].second->id] = true;
+                    if (updates[i].second->children.size() > 0) {
+                        materialize[updates[i].second->id] = true;
+                    }
+                }
+                for (size_t i = n; i-- > 0;) {
+                    Node node = graph->nodes[i];
+                    if (not needed[i]) {
+                        continue;
+                    }
+                    if (node->op->name == "Transpose" and not target[i]) {
+                        // The transpose is folded only if all of its children are MatrixMul
+                        folded[i] = true;
+                        for (size_t j = 0; j < node->children.size(); j++) {
+                            if (needed[node->children[j]->id] and node->children[j]->op->name != "MatrixMul") {
+                                folded[i] = false;
+                            }
+                        }
+                    }
+                    if (not node->execution.inlined) {
+                        materialize[i] = true;
+                    }
+                    NodeVec ancestors = node->op->get_ancestors();
+                    for (size_t j = 0; j < ancestors.size(); j++) {
+                        needed[ancestors[j]->id] = true;
+                    }
+                    if (is_kernel(node) and not folded[i]) {
+                        for (size_t j = 0; j < ancestors.size(); j++) {
+                            materialize[ancestors[j]->id] = true;
+                        }
+                    }
+                    if (folded[i] or (node->op->name == "Broadcast" and not ancestors[0].is_scalar())) {
+                        materialize[ancestors[0]->id] = true;
+                    }
+                }
+                // Inlined update values must not read shared variables updated before them
+                std::vector<std::vector<size_t>> shared_reads(n);
+                for (size_t i = 0; i < n; i++) {
+                    Node node = graph->nodes[i];
+                    if (node->op->name == "Shared") {
+                        shared_reads[i].push_back(std::static_pointer_cast<op::SharedInput>(node->op)->var->id);
+                    } else if (needed[i] and not materialize[i] and not is_kernel(node)) {
+                        NodeVec ancestors = node->op->get_ancestors();
+                        for (size_t j = 0; j < ancestors.size(); j++) {
+                            if (not materialize[ancestors[j]->id]) {
+                                std::vector<size_t> &reads = shared_reads[ancestors[j]->id];
+                                shared_reads[i].insert(shared_reads[i].end(), reads.begin(), reads.end());
+                            }
+                        }
+                    }
+                }
+                for (size_t i = 0; i < updates.size(); i++) {
+                    size_t value_id = updates[i].second->id;
+                    for (size_t j = 0; j < i; j++) {
+                        size_t updated = std::static_pointer_cast<op::SharedInput>(updates[j].first->op)->var->id;
+                        std::vector<size_t> &reads = shared_reads[value_id];
+                        if (std::find(reads.begin(), reads.end(), updated) != reads.end()) {
+                            materialize[value_id] = true;
+                        }
+                    }
+                }
+                return materialize;
+            }
+
+            /**
+             * The condition under which each node is computed, which is empty for the nodes needed by the
+             * required targets or the updates. The rest are needed only by some of the optional targets
+             * and are computed only if any of them is fetched.
+             */
+            std::vector<std::string> plan_guards(Graph graph, NodeVec targets, Updates &updates) {
+                size_t n = graph->nodes.size();
+                size_t required_count = targets.size() - optional_count;
+                std::vector<bool> required(n, false);
+                std::vector<std::vector<size_t>> fetchers(n);
+                for (size_t i = 0; i < targets.size(); i++) {
+                    if (i < required_count) {
+                        required[targets[i]->id] = true;
+                    } else {
+                        fetchers[targets[i]->id].push_back(i - required_count);
+                    }
+                }
+                for (size_t i = 0; i < updates.size(); i++) {
+                    required[updates[i].second->id] = true;
+                }
+                std::vector<std::string> guards(n);
+                for (size_t i = n; i-- > 0;) {
+                    if (not needed[i] or (not required[i] and fetchers[i].size() == 0)) {
+                        continue;
+                    }
+                    NodeVec ancestors = graph->nodes[i]->op->get_ancestors();
+                    for (size_t j = 0; j < ancestors.size(); j++) {
+                        size_t id = ancestors[j]->id;
+                        required[id] = required[id] or required[i];
+                        for (size_t k = 0; k < fetchers[i].size(); k++) {
+                            if (std::find(fetchers[id].begin(), fetchers[id].end(), fetchers[i][k]) ==
+                                fetchers[id].end()) {
+                                fetchers[id].push_back(fetchers[i][k]);
+                            }
+                        }
+                    }
+                    if (not required[i]) {
+                        std::sort(fetchers[i].begin(), fetchers[i].end());
+                        for (size_t k = 0; k < fetchers[i].size(); k++) {
+                            guards[i] += (k > 0 ? " or fetch[" : "fetch[") + std::to_string(fetchers[i][k]) + "]";
+                        }
+                    }
+                }
+                return guards;
+            }
+
+            /** Writes a loop setting each element of the array to the expression */
+            void write_loop(std::ostream &f, std::string array, std::string expression, Shape shape) {
+                // The sizes are derived from the shape, so they are constants in specialized variants
+                SymInt elements = shape[0] * shape[1] * shape[2] * shape[3];
+                f << "\t{\n"
+                  << "\t\tmetadiff::kernels::HostDims const dims = " << dims_expression(shape) << ";\n"
+                  << "\t\tfloat *out = " << array << ".data;\n"
+                  << "\t\tlong long const n_elements = " << shape_value(elements) << ";\n"
+                  << "#pragma omp parallel for simd if(n_elements > 32768)\n"
+                  << "\t\tfor (long long idx = 0; idx < n_elements; idx++) {\n"
+                  << "\t\t\tout[idx] = " << expression << ";\n"
+                  << "\t\t}\n"
+                  << "\t}\n";
+            }
+
+            /**
+             * Binds each symbolic integer, which is directly a dimension of an input,
+             * to a local variable with the same name, such that shapes can be evaluated
+             */
+            void write_symbol_bindings(std::ofstream &f, NodeVec inputs) {
+                f << "\t// Bind all symbolic integers\n";
+                std::vector<bool> bound;
+                for (size_t i = 0; i < inputs.size(); i++) {
+                    for (int j = 0; j < 4; j++) {
+                        size_t variable;
+                        long long coefficient;
+                        if (not symbol_of(inputs[i]->shape[j], variable, coefficient)) {
+                            continue;
+                        }
+                        if (bound.size() <= variable) {
+                            bound.resize(variable + 1, false);
+                        }
+                        if (not bound[variable]) {
+                            std::string value = "inputs[" + std::to_string(i) + "].dims[" + std::to_string(j) + "]";
+                            if (coefficient != 1) {
+                                value += " / " + std::to_string(coefficient);
+                            }
+                            for (size_t k = 0; k < specialization.size(); k++) {
+                                if (specialization[k].first == variable) {
+                                    value = std::to_string(specialization[k].second);
+                                }
+                            }
+                            f << "\tlong long const " << SymInt::variable(variable).to_string_with_star()
+                              << " = " << value << ";\n";
+                            bound[variable] = true;
+                        }
+                    }
+                }
+            }
+
+            std::string dims_expression(Shape shape) {
+                return "metadiff::kernels::HostDims{{" + shape_value(shape[0]) + ", " + shape_value(shape[1]) + ", " +
+                       shape_value(shape[2]) + ", " + shape_value(shape[3]) + "}}";
+            }
+
+            /** Formats a value as a float literal, preserving its precision */
+            std::string float_literal(double value) {
+                if (std::isnan(value)) {
+                    return "NAN";
+                }
+                if (std::isinf(value)) {
+                    return value > 0 ? "INFINITY" : "(-INFINITY)";
+                }
+                std::stringstream stream;
+                stream << std::showpoint << std::setprecision(9) << value << "f";
+                return value < 0 ? "(" + stream.str() + ")" : stream.str();
+            }
+
+            /** The statement computing a kernel operator to the array of the node */
+            std::string kernel_statement(Node node, std::vector<std::string> &arrays) {
+                std::string array = "node_" + std::to_string(node->id);
+                NodeVec parents = node->op->get_parents();
+                // A product of two matrices is written to the array, which can be a bound output buffer
+                if (node->op->name == "MatrixMul" and parents.size() == 2) {
+                    std::string operands[2];
+                    std::string flags[2];
+                    for (size_t i = 0; i < 2; i++) {
+                        bool transposed = folded[parents[i]->id];
+                        operands[i] = arrays[transposed ? parents[i]->op->get_parents()[0]->id : parents[i]->id];
+                        flags[i] = transposed ? "true" : "false";
+                    }
+                    return "metadiff::kernels::matmul_into(" + array + ", " + operands[0] + ", " + operands[1] +
+                           ", " + flags[0] + ", " + flags[1] + ");";
+                }
+                return array + " = " + kernel_expression(node, arrays) + ";";
+            }
+
+            /** The expression of a kernel operator over whole arrays */
+            std::string kernel_expression(Node node, std::vector<std::string> &arrays) {
+                std::string op_name = node->op->name;
+                NodeVec parents = node->op->get_parents();
+                if (op_name == "Sum") {
+                    if (node.is_scalar()) {
+                        return "metadiff::kernels::sum(" + arrays[parents[0]->id] + ")";
+                    }
+                    Axes axes = std::static_pointer_cast<op::Sum>(node->op)->axes;
+                    std::string expression = "metadiff::kernels::sum(" + arrays[parents[0]->id] + ", {";
+                    for (size_t i = 0; i < axes.size(); i++) {
+                        expression += std::to_string(axes[i]) + (i < axes.size() - 1 ? ", " : "");
+                    }
+                    return expression + "})";
+                }
+                if (op_name == "Transpose") {
+                    return "metadiff::kernels::transpose(" + arrays[parents[0]->id] + ")";
+                }
+                if (op_name == "Reshape") {
+                    return arrays[parents[0]->id] + ".reshape(" + dims_expression(node->shape) + ")";
+                }
+                if (op_name == "MatrixMul") {
+                    // Transpose parents are passed as flags
+                    std::string expression;
+                    for (size_t i = 0; i < parents.size(); i++) {
+                        std::string operand = arrays[parents[i]->id];
+                        std::string flag = "false";
+                        if (folded[parents[i]->id]) {
+                            operand = arrays[parents[i]->op->get_parents()[0]->id];
+                            flag = "true";
+                        }
+                        if (i == 0) {
+                            expression = operand;
+                        } else if (i == 1) {
+                            std::string flag0 = folded[parents[0]->id] ? "true" : "false";
+                            expression = "metadiff::kernels::matmul(" + expression + ", " + operand + ", " +
+                                         flag0 + ", " + flag + ")";
+                        } else {
+                            expression = "metadiff::kernels::matmul(" + expression + ", " + operand + ", false, " +
+                                         flag + ")";
+                        }
+                    }
+                    return expression;
+                }
+                auto err = CompilationFailed("The operator " + op_name + " is not supported by the CpuBackend");
+                logger()->error() << err.msg;
+                throw err;
+            }
+
+            /** The expression of a single element at index 'idx' of an elementwise operator */
+            std::string element_expression(Node node, std::vector<std::string> &arrays,
+                                           std::vector<std::string> &elements) {
+                std::string op_name = node->op->name;
+                NodeVec parents = node->op->get_parents();
+                NodeVec args = node->op->get_arguments();
+
+                // Constant operators
+                if (op_name == "ConstValue") {
+                    return float_literal(std::static_pointer_cast<op::ConstantValue>(node->op)->value);
+                }
+                if (op_name == "Eye") {
+                    return "float(idx % dims[0] == idx / dims[0])";
+                }
+                if (op_name == "Hyperparameter") {
+                    return "hyperparameters[" +
+                           std::to_string(std::static_pointer_cast<op::Hyperparameter>(node->op)->slot) + "]";
+                }
+                if (op_name == "SymInt") {
+                    // The symbolic integers are bound from the dimensions of the inputs on every call
+                    return "float(" + shape_value(std::static_pointer_cast<op::SymIntWrapper>(node->op)->value) +
+                           ")";
+                }
+                // Base operators
+                if (op_name == "Alias" or op_name == "MakeConst" or op_name == "Cast") {
+                    return elements[parents[0]->id];
+                }
+                if (op_name == "Broadcast") {
+                    if (parents[0].is_scalar()) {
+                        return elements[parents[0]->id];
+                    }
+                    std::string parent = arrays[parents[0]->id];
+                    return parent + "[metadiff::kernels::broadcast_index(idx, dims, " + parent + ".dims)]";
+                }
+                if (op_name == "Add") {
+                    std::string expression = elements[parents[0]->id];
+                    for (size_t i = 1; i < parents.size(); i++) {
+                        if (parents[i]->op->name == "Neg") {
+                            expression += " - " + elements[parents[i]->op->get_parents()[0]->id];
+                        } else {
+                            expression += " + " + elements[parents[i]->id];
+                        }
+                    }
+                    return "(" + expression + ")";
+                }
+                if (op_name == "Neg") {
+                    return "(-" + elements[parents[0]->id] + ")";
+                }
+                if (op_name == "Mul") {
+                    std::string expression = elements[parents[0]->id];
+                    for (size_t i = 1; i < parents.size(); i++) {
+                        if (parents[i]->op->name == "Div") {
+                            expression += " / " + elements[parents[i]->op->get_parents()[0]->id];
+                        } else {
+                            expression += " * " + elements[parents[i]->id];
+                        }
+                    }
+                    return "(" + expression + ")";
+                }
+                if (op_name == "Div") {
+                    return "(1.0f / " + elements[parents[0]->id] + ")";
+                }
+                // Logical operators
+                if (op_name == "Not") {
+                    return "float(" + elements[parents[0]->id] + " == 0.0f)";
+                }
+                std::vector<std::string> comparisons = {"Gt", ">", "Ge", ">=", "Lt", "<", "Le", "<=",
+                                                        "Eq", "==", "NotEq", "!="};
+                for (size_t i = 0; i < comparisons.size(); i += 2) {
+                    if (op_name == comparisons[i]) {
+                        return "float(" + elements[parents[0]->id] + " " + comparisons[i + 1] + " " +
+                               elements[parents[1]->id] + ")";
+                    }
+                }
+                if (op_name == "And") {
+                    return "float(" + elements[parents[0]->id] + " != 0.0f && " +
+                           elements[parents[1]->id] + " != 0.0f)";
+                }
+                if (op_name == "Or") {
+                    return "float(" + elements[parents[0]->id] + " != 0.0f || " +
+                           elements[parents[1]->id] + " != 0.0f)";
+                }
+                if (op_name == "ZeroElem") {
+                    return "float(" + elements[parents[0]->id] + " == 0.0f)";
+                }
+                if (op_name == "IsNaN") {
+                    return "float(std::isnan(" + elements[parents[0]->id] + "))";
+                }
+                if (op_name == "IsInf") {
+                    return "float(std::isinf(" + elements[parents[0]->id] + "))";
+                }
+                if (op_name == "Select") {
+                    return "(" + elements[args[0]->id] + " != 0.0f ? " + elements[parents[0]->id] +
+                           " : " + elements[parents[1]->id] + ")";
+                }
+                // Elementwise operators
+                if (op_name == "Square") {
+                    return "(" + elements[parents[0]->id] + " * " + elements[parents[0]->id] + ")";
+                }
+                if (op_name == "Cot") {
+                    return "(1.0f / std::tan(" + elements[parents[0]->id] + "))";
+                }
+                // These are vectorized by kernels::vmath with the precision of the graph
+                std::string vmath = node->graph->precision == core::FAST ?
+                                    "metadiff::kernels::vmath::fast::" : "metadiff::kernels::vmath::";
+                if (op_name == "Coth") {
+                    return "(1.0f / " + vmath + "tanh(" + elements[parents[0]->id] + "))";
+                }
+                if (op_name == "Pow") {
+                    return "std::pow(" + elements[parents[0]->id] + ", " + elements[parents[1]->id] + ")";
+                }
+                std::vector<std::string> functions = {"Exp", vmath + "exp", "Log", vmath + "log",
+                                                      "Log1p", vmath + "log1p", "Tanh", vmath + "tanh",
+                                                      "Log10", "std::log10", "Abs", "std::fabs",
+                                                      "Sin", "std::sin", "Cos", "std::cos", "Tan", "std::tan",
+                                                      "Sinh", "std::sinh", "Cosh", "std::cosh"};
+                for (size_t i = 0; i < functions.size(); i += 2) {
+                    if (op_name == functions[i]) {
+                        return functions[i + 1] + "(" + elements[parents[0]->id] + ")";
+                    }
+                }
+                // Optimized operators
+                if (op_name == "BinCrossEntropyLogit") {
+                    std::string p = elements[parents[0]->id];
+                    std::string sfx = elements[args[0]->id];
+                    std::string sfmx = elements[args[1]->id];
+                    return "(" + p + " * " + sfmx + " + (1.0f - " + p + ") * " + sfx + ")";
+                }
+                auto err = CompilationFailed("The operator " + op_name + " is not supported by the CpuBackend");
+                logger()->error() << err.msg;
+                throw err;
+            }
+
+            void write_host_interface(std::ostream &f) {
+                f << "namespace metadiff{\n"
+                        "    namespace shared{\n"
+                        "        /** A shared variable stored in host memory, used by the CpuBackend */\n"
+                        "        class HostVariable: public SharedVariable {\n"
+                        "        public:\n"
+                        "            kernels::HostArray value;\n"
+                        "            HostVariable(size_t id,\n"
+                        "                         kernels::HostArray value,\n"
+                        "                         std::string name):\n"
+                        "                    SharedVariable(id, value.dims, name),\n"
+                        "                    value(value) {};\n"
+                        "\n"
+                        "            core::dType get_dtype() const{\n"
+                        "                return core::f32;\n"
+                        "            }\n"
+                        "        };\n"
+                        "\n"
+                        "        typedef std::shared_ptr<HostVariable> HostShared;\n"
+                        "    }\n"
+                        "}\n"
+                        "\n"
+                        "using metadiff::kernels::HostArray;\n"
+                        "using metadiff::shared::HostVariable;\n"
+                        "using metadiff::shared::HostShared;\n"
+                        "template <size_t T>\n\n"
+                        "inline HostShared get(std::vector<SharedPtr>& shared_vars){\n"
+                        "     return std::static_pointer_cast<HostVariable>(shared_vars[T]);\n"
+                        "}\n";
+            }
+        };
+    }
+}
+
+#endif //AUTODIFF_BACKENDS_CPU_H
@@ -0,0 +1,847 @@
+//
+// Created by alex on 16/10/16.
+//
+
+#ifndef AUTODIFF_BACKENDS_INTERPRETER_H
+#define AUTODIFF_BACKENDS_INTERPRETER_H
+
+namespace metadiff{
+    namespace backend {
+        using namespace exceptions;
+        using kernels::HostArray;
+
+        /** The operations of the program executed by the InterpreterBackend */
+        enum opCode {
+            /** Reads one of the inputs */
+            INPUT = 0,
+            /** Reads the value of a shared variable */
+            SHARED = 1,
+            /** Fills an array with a constant */
+            CONSTANT = 2,
+            /** Creates an identity matrix */
+            EYE = 3,
+            /** Shares the array of its operand */
+            ALIAS = 4,
+            /** Applies a unary function to each element */
+            UNARY = 5,
+            /** Folds a binary function over the elements of all operands */
+            BINARY = 6,
+            /** Applies a function of three arguments to each element */
+            TERNARY = 7,
+            /** Broadcasts along the unit dimensions of the operand */
+            BROADCAST = 8,
+            SUM = 9,
+            TRANSPOSE = 10,
+            RESHAPE = 11,
+            MATMUL = 12,
+            /** Evaluates a symbolic integer for the dimensions of the inputs */
+            SYMBOLIC = 13,
+            /** Reads the value of a hyperparameter */
+            HYPERPARAMETER = 14,
+            /** The diagonal of a square matrix, or a diagonal matrix of a vector */
+            DIAG = 15,
+            /** Sums the diagonal of a square matrix */
+            TRACE = 16,
+            /** Permutes the dimensions of the operand */
+            REORDER = 17,
+            /** Fills a vector with the integers from a symbolic start */
+            SEQUENCE = 18
+        };
+
+        typedef float (*UnaryFunction)(float);
+        typedef float (*BinaryFunction)(float, float);
+        typedef float (*TernaryFunction)(float, float, float);
+
+        /** A single instruction of the program, which computes the value of one node */
+        class Instruction {
+        public:
+            opCode code;
+            /** The id of the node, which is also the register the result is stored in */
+            size_t node;
+            /** Registers of the operands */
+            std::vector<size_t> operands;
+            /** For MATMUL, whether each operand is transposed */
+            std::vector<bool> transposed;
+            /** The shape of the result, evaluated on every call */
+            Shape shape;
+            /** The position of the input for INPUT, the id of the variable for SHARED, the slot for HYPERPARAMETER */
+            size_t index;
+            /** The value for CONSTANT */
+            float value;
+            /** The symbolic integer for SYMBOLIC, the start for SEQUENCE */
+            SymInt symbol;
+            /** The axes for SUM, the order for REORDER */
+            Axes axes;
+            UnaryFunction unary;
+            BinaryFunction binary;
+            TernaryFunction ternary;
+            /** Registers which are not used after this instruction and can be released */
+            std::vector<size_t> releases;
+
+            Instruction(opCode code, Node node) :
+                    code(code),
+                    node(node->id),
+                    shape(node->shape),
+                    index(0),
+                    value(0),
+                    unary(nullptr),
+                    binary(nullptr),
+                    ternary(nullptr) { };
+        };
+
+        /**
+         * Backend which executes the graph directly, by walking a flat program of instructions
+         * over HostArray, one for each node, with the kernels from kernels.h.
+         * Nothing is generated or compiled, thus a function is ready as soon as it is defined,
+         * which makes it suitable for small graphs, tests and as a reference for the values
+         * computed by the compiled backends. Each node is computed in its own array, without fusion.
+         * The linear algebra operators MatrixInv, Det and LogDet, as well as MaxAndArgMax and SortAndArgSort
+         * with their MultyNodeIndex are not supported, and translating a graph with any of them
+         * throws CompilationFailed. The indexing operators are not defined yet by the graph either.
+         */
+        class InterpreterBackend : public FunctionBackend<HostArray> {
+        public:
+            /** The program computing the targets and the updates */
+            std::vector<Instruction> program;
+
+            /** For each symbolic integer bound to an input dimension - the variable, the input and the dimension */
+            std::vector<std::array<size_t, 4>> symbol_bindings;
+
+            /** The number of symbolic integers in the graph */
+            size_t symbol_count;
+
+            /** The number of registers, one for each node in the graph */
+            size_t register_count;
+
+            /** Pairs of the id of a shared variable and the register of its new value */
+            std::vector<std::pair<size_t, size_t>> update_registers;
+
+            /** Registers of the targets */
+            std::vector<size_t> target_registers;
+
+            /** The value of each hyperparameter, indexed by its slot */
+            std::vector<float> hyperparameters;
+
+            /** The graph the program was translated from, which the measurements are recorded to */
+            Graph graph;
+
+            /** The total measured time of each node */
+            std::vector<double> node_times;
+
+            /** The size in bytes of the value of each node in the last call */
+            std::vector<long long> node_bytes;
+
+            InterpreterBackend(bool debug = false) :
+                    FunctionBackend("Interpreter", debug),
+                    symbol_count(0),
+                    register_count(0) { };
+
+            InterpreterBackend(std::string dir_path, bool debug = false) :
+                    FunctionBackend("Interpreter", dir_path, debug),
+                    symbol_count(0),
+                    register_count(0) { };
+
+            ~InterpreterBackend() {
+                synchronize();
+            }
+
+            /** The interpreter does not generate any code */
+            void generate_source(std::string source_dir,
+                                 Graph graph,
+                                 std::vector<Node> inputs,
+                                 std::vector<Node> targets) { };
+
+            /** The interpreter does not compile any code */
+            void compile(std::string source_dir, std::string target_dir, std::string graph_name,
+                         instructionSet isa, std::string build_flags) { };
+
+            /** The interpreter does not link any code */
+            func_ptr link(std::string target_dir, std::string graph_name) {
+                return nullptr;
+            };
+
+            /** Translates the graph to the program, instead of generating, compiling and linking code */
+            void compile_function(Graph graph,
+                                  std::vector<Node> inputs,
+                                  std::vector<Node> targets,
+                                  Updates &updates) {
+                logger()->debug() << "Translating graph " << graph->name << " to a program";
+                trace::Span span("translate", "backend");
+                span.arg("graph", graph->name);
+                verify_inputs(graph, inputs, targets);
+                graph->add_temporary_updates(updates);
+                check_memory(graph, targets);
+                std::vector<Updates> all_updates{graph->updates, graph->temporary_updates};
+                Updates function_updates;
+                for (size_t i = 0; i < all_updates.size(); i++) {
+                    function_updates.insert(function_updates.end(), all_updates[i].begin(), all_updates[i].end());
+                }
+                graph->clear_temporary_updates();
+
+                this->graph = graph;
+                node_times = std::vector<double>(graph->nodes.size(), 0);
+                node_bytes = std::vector<long long>(graph->nodes.size(), -1);
+                profiled_calls = 0;
+                program.clear();
+                symbol_bindings.clear();
+                update_registers.clear();
+                target_registers.clear();
+                symbol_count = graph->sym_integer_count;
+                register_count = graph->nodes.size();
+                bind_symbols(inputs);
+
+                // The initial values of the hyperparameters, unless they were set already
+                hyperparameters.clear();
+                for (size_t i = 0; i < graph->nodes.size(); i++) {
+                    if (graph->nodes[i]->op->name == "Hyperparameter") {
+                        auto op = std::static_pointer_cast<op::Hyperparameter>(graph->nodes[i]->op);
+                        if (hyperparameters.size() <= op->slot) {
+                            hyperparameters.resize(op->slot + 1, 0);
+                        }
+                        hyperparameters[op->slot] = float(op->value);
+                    }
+                }
+                for (auto it = hyperparameter_values.begin(); it != hyperparameter_values.end(); it++) {
+                    if (it->first < hyperparameters.size()) {
+                        hyperparameters[it->first] = it->second;
+                    }
+                }
+
+                size_t n = graph->nodes.size();
+                std::vector<bool> pinned(n, false);
+                for (size_t i = 0; i < targets.size(); i++) {
+                    target_registers.push_back(targets[i]->id);
+                    pinned[targets[i]->id] = true;
+                }
+                for (size_t i = 0; i < function_updates.size(); i++) {
+                    size_t shared_id = std::static_pointer_cast<op::SharedInput>(
+                            function_updates[i].first->op)->var->id;
+                    update_registers.push_back({shared_id, function_updates[i].second->id});
+                    pinned[function_updates[i].second->id] = true;
+                }
+                std::vector<bool> needed = needed_nodes(graph, pinned);
+
+                // Transposes with only MatrixMul children are passed to them as flags
+                std::vector<bool> folded(n, false);
+                for (size_t i = 0; i < n; i++) {
+                    Node node = graph->nodes[i];
+                    if (needed[i] and not pinned[i] and node->op->name == "Transpose") {
+                        folded[i] = true;
+                        for (size_t j = 0; j < node->children.size(); j++) {
+                            if (needed[node->children[j]->id] and node->children[j]->op->name != "MatrixMul") {
+                                folded[i] = false;
+                            }
+                        }
+                    }
+                }
+
+                std::vector<long long> positions(n, -1);
+                for (size_t i = 0; i < inputs.size(); i++) {
+                    positions[inputs[i]->id] = i;
+                }
+                for (size_t i = 0; i < n; i++) {
+                    if (needed[i] and not folded[i]) {
+                        program.push_back(translate(graph->nodes[i], folded, positions));
+                    }
+                }
+                plan_releases(pinned);
+                logger()->debug() << "The program has " << program.size() << " instructions";
+            }
+
+            /** Executes the program over the inputs and the shared variables given */
+            std::vector<HostArray> eval(std::vector<HostArray> &inputs, std::vector<SharedPtr> &shared_vars) {
+                trace::Span span("interpret", "eval");
+                std::vector<long long> symbols(symbol_count, 0);
+                for (size_t i = 0; i < symbol_bindings.size(); i++) {
+                    symbols[symbol_bindings[i][0]] = inputs[symbol_bindings[i][1]].dims[symbol_bindings[i][2]] /
+                                                     (long long) symbol_bindings[i][3];
+                }
+                std::vector<HostArray> registers(register_count);
+                for (size_t i = 0; i < program.size(); i++) {
+                    if (debug) {
+                        logger()->trace() << "Calculating node '" << program[i].node << "'";
+                    }
+                    if (profile) {
+                        auto start = std::chrono::steady_clock::now();
+                        execute(program[i], registers, symbols, inputs, shared_vars);
+                        auto end = std::chrono::steady_clock::now();
+                        std::chrono::duration<double> time = end - start;
+                        node_times[program[i].node] += time.count();
+                        node_bytes[program[i].node] = registers[program[i].node].elements() * sizeof(float);
+                        if (trace::enabled()) {
+                            Node node = graph->nodes[program[i].node];
+                            trace::record(node->op->name + "[" + std::to_string(node->id) + "]", "node", start, end,
+                                          {{"group", node->group.lock()->full_name}});
+                        }
+                    } else {
+                        execute(program[i], registers, symbols, inputs, shared_vars);
+                    }
+                    for (size_t j = 0; j < program[i].releases.size(); j++) {
+                        registers[program[i].releases[j]] = HostArray();
+                    }
+                }
+
+                // All of the new values and the targets are taken before any of the shared variables is modified
+                std::vector<HostArray> values;
+                for (size_t i = 0; i < update_registers.size(); i++) {
+                    values.push_back(registers[update_registers[i].second]);
+                }
+                std::vector<HostArray> outputs;
+                for (size_t i = 0; i < target_registers.size(); i++) {
+                    outputs.push_back(registers[target_registers[i]]);
+                }
+                for (size_t i = 0; i < update_registers.size(); i++) {
+                    float *updated = host_variable(shared_vars, update_registers[i].first)->value.data;
+                    for (size_t j = 0; j < values.size(); j++) {
+                        if (values[j].data == updated) {
+                            values[j] = values[j].copy();
+                        }
+                    }
+                    for (size_t j = 0; j < outputs.size(); j++) {
+                        if (outputs[j].data == updated) {
+                            outputs[j] = outputs[j].copy();
+                        }
+                    }
+                }
+                for (size_t i = 0; i < update_registers.size(); i++) {
+                    HostArray &variable = host_variable(shared_vars, update_registers[i].first)->value;
+                    if (values[i].is_scalar()) {
+                        variable.fill(values[i][0]);
+                    } else {
+                        std::memcpy(variable.data, values[i].data, (size_t) variable.elements() * sizeof(float));
+                    }
+                }
+                if (profile and ++profiled_calls == profile_steps) {
+                    record_profile();
+                }
+                return outputs;
+            }
+
+            /**
+             * Writes the mean measurements of all computed nodes to their ExecutionData,
+             * saves them to the profile_db of the graph, if it has one, and exports them to profile.txt.
+             * Inputs, shared variables and views are not measured, as they are never computed.
+             */
+            void record_profile() {
+                if (profiled_calls == 0) {
+                    return;
+                }
+                for (size_t i = 0; i < program.size(); i++) {
+                    opCode code = program[i].code;
+                    if (code != INPUT and code != SHARED and code != ALIAS and code != RESHAPE) {
+                        core::ExecutionData &execution = graph->nodes[program[i].node]->execution;
+                        execution.time = node_times[program[i].node] / profiled_calls;
+                        execution.bytes = node_bytes[program[i].node];
+                    }
+                }
+                if (graph->profile_db != "") {
+                    graph->save_profile();
+                }
+                export_profile(graph);
+            }
+
+            std::vector<HostArray> eval(std::vector<HostArray> &inputs) {
+                return eval(inputs, shared::shared_vars);
+            }
+
+            void set_hyperparameter(Node node, double value) {
+                FunctionBackend::set_hyperparameter(node, value);
+                size_t slot = std::static_pointer_cast<op::Hyperparameter>(node->op)->slot;
+                if (slot < hyperparameters.size()) {
+                    hyperparameters[slot] = float(value);
+                }
+            }
+
+            /** Runs a step for each batch, returning the targets of the last one or their sum over all steps */
+            std::vector<HostArray> eval_steps(std::vector<std::vector<HostArray>> &batches, bool accumulate = false) {
+                std::vector<HostArray> totals(target_registers.size());
+                std::vector<HostArray> outputs;
+                for (size_t step = 0; step < batches.size(); step++) {
+                    outputs = eval(batches[step], shared::shared_vars);
+                    for (size_t k = 0; accumulate and k < outputs.size(); k++) {
+                        kernels::accumulate(totals[k], outputs[k]);
+                    }
+                }
+                if (accumulate or batches.size() == 0) {
+                    return totals;
+                }
+                return outputs;
+            }
+
+            /** Copies the targets to the buffers of the outputs, which must have the same number of elements */
+            void eval_into(std::vector<HostArray> &inputs, std::vector<HostArray> &outputs) {
+                if (outputs.size() != target_registers.size()) {
+                    auto err = InvalidArguments(NodeVec{}, "eval_into", "Expected " +
+                                                std::to_string(target_registers.size()) + " outputs, got " +
+                                                std::to_string(outputs.size()));
+                    logger()->error() << err.msg;
+                    throw err;
+                }
+                std::vector<HostArray> results = eval(inputs, shared::shared_vars);
+                for (size_t i = 0; i < results.size(); i++) {
+                    kernels::assign(outputs[i], results[i]);
+                }
+            }
+
+            /** Binds each symbolic integer, which is directly a dimension of an input */
+            void bind_symbols(NodeVec inputs) {
+                std::vector<bool> bound(symbol_count, false);
+                for (size_t i = 0; i < inputs.size(); i++) {
+                    for (size_t j = 0; j < 4; j++) {
+                        size_t variable;
+                        long long coefficient;
+                        if (not symbol_of(inputs[i]->shape[j], variable, coefficient)) {
+                            continue;
+                        }
+                        if (not bound[variable]) {
+                            symbol_bindings.push_back({{variable, i, j, (size_t) coefficient}});
+                            bound[variable] = true;
+                        }
+                    }
+                }
+            }
+
+            /** Nodes from which any of the pinned ones depend on */
+            std::vector<bool> needed_nodes(Graph graph, std::vector<bool> const &pinned) {
+                std::vector<bool> needed = pinned;
+                for (size_t i = graph->nodes.size(); i-- > 0;) {
+                    if (needed[i]) {
+                        NodeVec ancestors = graph->nodes[i]->op->get_ancestors();
+                        for (size_t j = 0; j < ancestors.size(); j++) {
+                            needed[ancestors[j]->id] = true;
+                        }
+                    }
+                }
+                return needed;
+            }
+
+            /** Releases every register after its last use, except for the pinned ones */
+            void plan_releases(std::vector<bool> const &pinned) {
+                std::vector<long long> last_use(register_count, -1);
+                for (size_t i = 0; i < program.size(); i++) {
+                    last_use[program[i].node] = i;
+                    for (size_t j = 0; j < program[i].operands.size(); j++) {
+                        last_use[program[i].operands[j]] = i;
+                    }
+                }
+                for (size_t i = 0; i < register_count; i++) {
+                    if (last_use[i] >= 0 and not pinned[i]) {
+                        program[last_use[i]].releases.push_back(i);
+                    }
+                }
+            }
+
+            /** Translates a single node to an instruction */
+            Instruction translate(Node node, std::vector<bool> const &folded, std::vector<long long> const &positions) {
+                std::string op_name = node->op->name;
+                NodeVec parents = node->op->get_parents();
+                NodeVec args = node->op->get_arguments();
+                bool fast = node->graph->precision == core::FAST;
+
+                if (op_name == "Input") {
+                    Instruction instruction(INPUT, node);
+                    instruction.index = positions[node->id];
+                    return instruction;
+                }
+                if (op_name == "Shared") {
+                    Instruction instruction(SHARED, node);
+                    instruction.index = std::static_pointer_cast<op::SharedInput>(node->op)->var->id;
+                    return instruction;
+                }
+                if (op_name == "ConstValue") {
+                    Instruction instruction(CONSTANT, node);
+                    instruction.value = std::static_pointer_cast<op::ConstantValue>(node->op)->value;
+                    return instruction;
+                }
+                if (op_name == "Eye") {
+                    return Instruction(EYE, node);
+                }
+                if (op_name == "Hyperparameter") {
+                    Instruction instruction(HYPERPARAMETER, node);
+                    instruction.index = std::static_pointer_cast<op::Hyperparameter>(node->op)->slot;
+                    return instruction;
+                }
+                if (op_name == "SymInt") {
+                    Instruction instruction(SYMBOLIC, node);
+                    instruction.symbol = std::static_pointer_cast<op::SymIntWrapper>(node->op)->value;
+                    return instruction;
+                }
+                if (op_name == "Sequence") {
+                    Instruction instruction(SEQUENCE, node);
+                    instruction.symbol = std::static_pointer_cast<op::Sequence>(node->op)->start;
+                    return instruction;
+                }
+                Instruction instruction(ALIAS, node);
+                for (size_t i = 0; i < parents.size(); i++) {
+                    instruction.operands.push_back(parents[i]->id);
+                }
+                if (op_name == "Alias" or op_name == "MakeConst" or op_name == "Cast") {
+                    return instruction;
+                }
+                if (op_name == "Broadcast") {
+                    instruction.code = BROADCAST;
+                    return instruction;
+                }
+                if (op_name == "Sum") {
+                    instruction.code = SUM;
+                    instruction.axes = std::static_pointer_cast<op::Sum>(node->op)->axes;
+                    return instruction;
+                }
+                if (op_name == "Transpose") {
+                    instruction.code = TRANSPOSE;
+                    return instruction;
+                }
+                if (op_name == "Reshape") {
+                    instruction.code = RESHAPE;
+                    return instruction;
+                }
+                if (op_name == "Reorder") {
+                    instruction.code = REORDER;
+                    instruction.axes = std::static_pointer_cast<op::Reorder>(node->op)->order;
+                    return instruction;
+                }
+                if (op_name == "Diag") {
+                    instruction.code = DIAG;
+                    return instruction;
+                }
+                if (op_name == "Trace") {
+                    instruction.code = TRACE;
+                    return instruction;
+                }
+                if (op_name == "MatrixMul") {
+                    instruction.code = MATMUL;
+                    for (size_t i = 0; i < parents.size(); i++) {
+                        instruction.transposed.push_back(folded[parents[i]->id]);
+                        if (folded[parents[i]->id]) {
+                            instruction.operands[i] = parents[i]->op->get_parents()[0]->id;
+                        }
+                    }
+                    return instruction;
+                }
+                if (op_name == "Select") {
+                    instruction.code = TERNARY;
+                    instruction.operands.insert(instruction.operands.begin(), args[0]->id);
+                    instruction.ternary = [](float condition, float x, float y) { return condition != 0.0f ? x : y; };
+                    return instruction;
+                }
+                if (op_name == "BinCrossEntropyLogit") {
+                    instruction.code = TERNARY;
+                    instruction.operands = {parents[0]->id, args[0]->id, args[1]->id};
+                    instruction.ternary = [](float p, float sfx, float sfmx) { return p * sfmx + (1.0f - p) * sfx; };
+                    return instruction;
+                }
+                instruction.binary = binary_function(op_name);
+                if (instruction.binary != nullptr) {
+                    instruction.code = BINARY;
+                    return instruction;
+                }
+                instruction.unary = unary_function(op_name, fast);
+                if (instruction.unary != nullptr) {
+                    instruction.code = UNARY;
+                    return instruction;
+                }
+                auto err = CompilationFailed("The operator " + op_name + " is not supported by the InterpreterBackend");
+                logger()->error() << err.msg;
+                throw err;
+            }
+
+            /** The function of an elementwise operator with one parent, nullptr if there is none */
+            static UnaryFunction unary_function(std::string op_name, bool fast) {
+                // These are computed by kernels::vmath with the precision of the graph
+                if (op_name == "Exp") {
+                    return fast ? kernels::vmath::fast::exp : kernels::vmath::exp;
+                }
+                if (op_name == "Log") {
+                    return fast ? kernels::vmath::fast::log : kernels::vmath::log;
+                }
+                if (op_name == "Log1p") {
+                    return fast ? kernels::vmath::fast::log1p : kernels::vmath::log1p;
+                }
+                if (op_name == "Tanh") {
+                    return fast ? kernels::vmath::fast::tanh : kernels::vmath::tanh;
+                }
+                if (op_name == "Coth") {
+                    if (fast) {
+                        return [](float x) { return 1.0f / kernels::vmath::fast::tanh(x); };
+                    }
+                    return [](float x) { return 1.0f / kernels::vmath::tanh(x); };
+                }
+                if (op_name == "Neg") {
+                    return [](float x) { return -x; };
+                }
+                if (op_name == "Div") {
+                    return [](float x) { return 1.0f / x; };
+                }
+                if (op_name == "Not" or op_name == "ZeroElem") {
+                    return [](float x) { return float(x == 0.0f); };
+                }
+                if (op_name == "IsNaN") {
+                    return [](float x) { return float(std::isnan(x)); };
+                }
+                if (op_name == "IsInf") {
+                    return [](float x) { return float(std::isinf(x)); };
+                }
+                if (op_name == "Square") {
+                    return [](float x) { return x * x; };
+                }
+                if (op_name == "Abs") {
+                    return [](float x) { return std::fabs(x); };
+                }
+                if (op_name == "Log10") {
+                    return [](float x) { return std::log10(x); };
+                }
+                if (op_name == "Sin") {
+                    return [](float x) { return std::sin(x); };
+                }
+                if (op_name == "Cos") {
+                    return [](float x) { return std::cos(x); };
+                }
+                if (op_name == "Tan") {
+                    return [](float x) { return std::tan(x); };
+                }
+                if (op_name == "Cot") {
+                    return [](float x) { return 1.0f / std::tan(x); };
+                }
+                if (op_name == "Sinh") {
+                    return [](float x) { return std::sinh(x); };
+                }
+                if (op_name == "Cosh") {
+                    return [](float x) { return std::cosh(x); };
+                }
+                return nullptr;
+            }
+
+            /** The function of an elementwise operator with two or more parents, nullptr if there is none */
+            static BinaryFunction binary_function(std::string op_name) {
+                if (op_name == "Add") {
+                    return [](float x, float y) { return x + y; };
+                }
+                if (op_name == "Mul") {
+                    return [](float x, float y) { return x * y; };
+                }
+                if (op_name == "Pow") {
+                    return [](float x, float y) { return std::pow(x, y); };
+                }
+                if (op_name == "Gt") {
+                    return [](float x, float y) { return float(x > y); };
+                }
+                if (op_name == "Ge") {
+                    return [](float x, float y) { return float(x >= y); };
+                }
+                if (op_name == "Lt") {
+                    return [](float x, float y) { return float(x < y); };
+                }
+                if (op_name == "Le") {
+                    return [](float x, float y) { return float(x <= y); };
+                }
+                if (op_name == "Eq") {
+                    return [](float x, float y) { return float(x == y); };
+                }
+                if (op_name == "NotEq") {
+                    return [](float x, float y) { return float(x != y); };
+                }
+                if (op_name == "And") {
+                    return [](float x, float y) { return float(x != 0.0f and y != 0.0f); };
+                }
+                if (op_name == "Or") {
+                    return [](float x, float y) { return float(x != 0.0f or y != 0.0f); };
+                }
+                return nullptr;
+            }
+
+            static shared::HostShared host_variable(std::vector<SharedPtr> &shared_vars, size_t id) {
+                return std::static_pointer_cast<shared::HostVariable>(shared_vars[id]);
+            }
+
+            /** Evaluates the shape for the values of the symbolic integers */
+            static kernels::HostDims evaluate(Shape const &shape, std::vector<long long> const &symbols) {
+                return kernels::HostDims{{shape[0].eval<long long>(symbols), shape[1].eval<long long>(symbols),
+                                          shape[2].eval<long long>(symbols), shape[3].eval<long long>(symbols)}};
+            }
+
+            /** Executes a single instruction, storing the result in its register */
+            void execute(Instruction const &instruction,
+                         std::vector<HostArray> &registers,
+                         std::vector<long long> const &symbols,
+                         std::vector<HostArray> &inputs,
+                         std::vector<SharedPtr> &shared_vars) {
+                HostArray &result = registers[instruction.node];
+                std::vector<HostArray const *> operands;
+                for (size_t i = 0; i < instruction.operands.size(); i++) {
+                    operands.push_back(&registers[instruction.operands[i]]);
+                }
+                switch (instruction.code) {
+                    case INPUT: {
+                        result = inputs[instruction.index];
+                        return;
+                    }
+                    case SHARED: {
+                        result = host_variable(shared_vars, instruction.index)->value;
+                        return;
+                    }
+                    case CONSTANT: {
+                        result = HostArray::constant(instruction.value, evaluate(instruction.shape, symbols));
+                        return;
+                    }
+                    case HYPERPARAMETER: {
+                        result = HostArray::constant(hyperparameters[instruction.index],
+                                                     evaluate(instruction.shape, symbols));
+                        return;
+                    }
+                    case SYMBOLIC: {
+                        result = HostArray::constant(float(instruction.symbol.eval<long long>(symbols)),
+                                                     evaluate(instruction.shape, symbols));
+                        return;
+                    }
+                    case ALIAS: {
+                        result = *operands[0];
+                        return;
+                    }
+                    case SUM: {
+                        if (evaluate(instruction.shape, symbols) == kernels::HostDims{{1, 1, 1, 1}}) {
+                            result = kernels::sum(*operands[0]);
+                        } else {
+                            result = kernels::sum(*operands[0], instruction.axes);
+                        }
+                        return;
+                    }
+                    case TRANSPOSE: {
+                        result = kernels::transpose(*operands[0]);
+                        return;
+                    }
+                    case RESHAPE: {
+                        result = operands[0]->reshape(evaluate(instruction.shape, symbols));
+                        return;
+                    }
+                    case MATMUL: {
+                        result = kernels::matmul(*operands[0], *operands[1],
+                                                 instruction.transposed[0], instruction.transposed[1]);
+                        for (size_t i = 2; i < operands.size(); i++) {
+                            result = kernels::matmul(result, *operands[i], false, instruction.transposed[i]);
+                        }
+                        return;
+                    }
+                    default:
+                        break;
+                }
+
+                // Elementwise instructions, where scalar operands are used for every element
+                HostArray output(evaluate(instruction.shape, symbols));
+                float *out = output.data;
+                long long const n = output.elements();
+                switch (instruction.code) {
+                    case EYE: {
+                        long long const rows = output.dims[0];
+                        for (long long i = 0; i < n; i++) {
+                            out[i] = float(i % rows == i / rows);
+                        }
+                        break;
+                    }
+                    case BROADCAST: {
+                        HostArray const &in = *operands[0];
+                        for (long long i = 0; i < n; i++) {
+                            out[i] = in[kernels::broadcast_index(i, output.dims, in.dims)];
+                        }
+                        break;
+                    }
+                    case SEQUENCE: {
+                        float const start = float(instruction.symbol.eval<long long>(symbols));
+                        for (long long i = 0; i < n; i++) {
+                            out[i] = start + i;
+                        }
+                        break;
+                    }
+                    case DIAG: {
+                        HostArray const &in = *operands[0];
+                        long long const rows = output.dims[0];
+                        if (output.dims[1] == 1) {
+                            // The diagonal of a square matrix
+                            for (long long i = 0; i < n; i++) {
+                                out[i] = in[i * rows + i];
+                            }
+                        } else {
+                            // A diagonal matrix of a vector
+                            for (long long i = 0; i < n; i++) {
+                                out[i] = i % rows == i / rows ? in[i % rows] : 0.0f;
+                            }
+                        }
+                        break;
+                    }
+                    case TRACE: {
+                        HostArray const &in = *operands[0];
+                        out[0] = 0;
+                        for (long long i = 0; i < in.dims[0]; i++) {
+                            out[0] += in[i * in.dims[0] + i];
+                        }
+                        break;
+                    }
+                    case REORDER: {
+                        // Dimension i of the result is dimension order[i] of the operand, the rest are units
+                        HostArray const &in = *operands[0];
+                        long long in_strides[4];
+                        long long stride = 1;
+                        for (int j = 0; j < 4; j++) {
+                            in_strides[j] = stride;
+                            stride *= in.dims[j];
+                        }
+                        for (long long i = 0; i < n; i++) {
+                            long long index = i;
+                            long long source = 0;
+                            for (size_t j = 0; j < instruction.axes.size(); j++) {
+                                source += (index % output.dims[j]) * in_strides[instruction.axes[j]];
+                                index /= output.dims[j];
+                            }
+                            out[i] = in[source];
+                        }
+                        break;
+                    }
+                    case UNARY: {
+                        float const *x = operands[0]->data;
+                        long long const sx = operands[0]->is_scalar() ? 0 : 1;
+                        UnaryFunction f = instruction.unary;
+#pragma omp parallel for if(n > 32768)
+                        for (long long i = 0; i < n; i++) {
+                            out[i] = f(x[i * sx]);
+                        }
+                        break;
+                    }
+                    case BINARY: {
+                        BinaryFunction f = instruction.binary;
+                        float const *acc = operands[0]->data;
+                        long long sa = operands[0]->is_scalar() ? 0 : 1;
+                        for (size_t j = 1; j < operands.size(); j++) {
+                            float const *y = operands[j]->data;
+                            long long const sy = operands[j]->is_scalar() ? 0 : 1;
+#pragma omp parallel for if(n > 32768)
+                            for (long long i = 0; i < n; i++) {
+                                out[i] = f(acc[i * sa], y[i * sy]);
+                            }
+                            acc = out;
+                            sa = 1;
+                        }
+                        break;
+                    }
+                    case TERNARY: {
+                        TernaryFunction f = instruction.ternary;
+                        float const *x = operands[0]->data;
+                        float const *y = operands[1]->data;
+                        float const *z = operands[2]->data;
+                        long long const sx = operands[0]->is_scalar() ? 0 : 1;
+                        long long const sy = operands[1]->is_scalar() ? 0 : 1;
+                        long long const sz = operands[2]->is_scalar() ? 0 : 1;
+#pragma omp parallel for if(n > 32768)
+                        for (long long i = 0; i < n; i++) {
+                            out[i] = f(x[i * sx], y[i * sy], z[i * sz]);
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                result = output;
+            }
+        };
+    }
+}
+
+#endif //AUTODIFF_BACKENDS_INTERPRETER_H
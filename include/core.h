@@ -29,6 +29,11 @@ namespace metadiff {
             return (shape[0] * shape[1]) * (shape[2] * shape[3]);
         }
 
+        /** Helper function for calculating the size in bytes of a tensor */
+        SymInt number_of_bytes(Shape shape, dType dtype){
+            return number_of_elements(shape) * (long long) byte_size(dtype);
+        }
+
         /** The class is an API wrapper around a NodeInternal */
         class Node {
         private:
@@ -303,6 +308,18 @@ namespace metadiff {
              */
             NodeVec get_ancestors() const;
 
+            /**
+             * The static cost of computing the owner. By default all ancestors are read and
+             * the owner is written once, with a single flop for each element written.
+             */
+            virtual OperatorCost cost() const;
+
+            /**
+             * The cost of an elementwise operator doing the given number of flops and
+             * transcendental functions per element of the owner
+             */
+            OperatorCost elementwise_cost(long long flops, long long transcendentals = 0) const;
+
             /**
              * Skips any alias operators to get the base operator
              */
@@ -354,6 +371,49 @@ namespace metadiff {
                     group(group) { }
         };
 
+        /**
+         * A prediction of the memory used while evaluating a graph, for concrete values of its symbolic integers.
+         * The nodes are computed in order of their ids and each is freed after its last child is computed.
+         */
+        class MemoryEstimate {
+        public:
+            /** Bytes of the shared variables, which are always held */
+            long long parameters;
+            /** Bytes of the forward nodes live at the peak, which are kept for the gradients */
+            long long activations;
+            /** Bytes of the gradient nodes live at the peak */
+            long long gradients;
+            /** Bytes of the rest of the nodes live at the peak, including the inputs */
+            long long temporaries;
+            /** The id of the node whose computation reaches the peak */
+            size_t peak_node;
+            /** The nodes live at the peak with their bytes, starting with the largest */
+            std::vector<std::pair<size_t, long long>> contributors;
+
+            MemoryEstimate() :
+                    parameters(0),
+                    activations(0),
+                    gradients(0),
+                    temporaries(0),
+                    peak_node(0) { };
+
+            long long peak() const {
+                return parameters + activations + gradients + temporaries;
+            }
+
+            /** A description of the peak, listing the largest contributors to it */
+            std::string report(size_t count = 5) const {
+                std::stringstream msg;
+                msg << "Peak memory of " << peak() << " bytes at node " << peak_node << ": "
+                << parameters << " parameters, " << activations << " activations, "
+                << gradients << " gradients, " << temporaries << " temporaries.";
+                for (size_t i = 0; i < contributors.size() and i < count; i++) {
+                    msg << "\n\tNode " << contributors[i].first << ": " << contributors[i].second << " bytes";
+                }
+                return msg.str();
+            }
+        };
+
         /**
          * The internal computation graph class
          * TODO: Should think what to be made private
@@ -374,6 +434,13 @@ namespace metadiff {
             dType max_float;
             /** The maximum integer precision to allow (See #dType) */
             dType max_int;
+            /** The accuracy of the transcendental functions in the generated code (See #mathPrecision) */
+            mathPrecision precision;
+            /**
+             * Path to the file with the node measurements of earlier runs, used by optimize().
+             * Measurements are stored per structural hash of the optimized graph. Empty disables it.
+             */
+            std::string profile_db;
             /** Type promotion function. See ::default_dType_promotion(dType type1,
                                       dType type2,
                                       dType max_float,
@@ -389,6 +456,8 @@ namespace metadiff {
 
 
             size_t sym_integer_count;
+            /** The range of each symbolic integer created by get_new_symbolic_integer(), by its id */
+            std::vector<SymRange> sym_integer_ranges;
             std::vector<std::shared_ptr<NodeInternal>> nodes;
             Updates updates;
 
@@ -406,6 +475,7 @@ namespace metadiff {
                 default_device = MASTER;
                 max_float = f32;
                 max_int = i32;
+                precision = PRECISE;
                 promote_type = [this](dType dtype1, dType dtype2)->dType {
                     return default_dType_promotion(dtype1, dtype2, this->max_float, this->max_int);
                 };
@@ -444,6 +514,15 @@ namespace metadiff {
             /** Returns the gradients of the objective with respect to the parameters provided */
             NodeVec gradient(Node objective, NodeVec params);
 
+            /** A hash of the operators, their ancestors and the shapes of all nodes, which identifies the computation */
+            size_t structural_hash() const;
+
+            /** Sets the measurements of all nodes from the profile_db, returns false if there are none for this graph */
+            bool load_profile();
+
+            /** Stores the measurements of all nodes in the profile_db, replacing any earlier ones for this graph */
+            void save_profile() const;
+
             /** Optimizes a graph with respect to the given nodes (INTERNAL) */
             Graph optimize(NodeVec &targets, Updates &updates, NodeVec &inputs,
                            NodeVec &new_targets, Updates &new_updates, NodeVec &new_inputs);
@@ -454,8 +533,32 @@ namespace metadiff {
             /** Adds an update for the shared node */
             void update_node(Node shared, Node update);
 
-            /** Returns the next unused symbolic integer */
-            SymInt get_new_symbolic_integer();
+            /** Returns the next unused symbolic integer, which takes values in the range given */
+            SymInt get_new_symbolic_integer(SymRange range = SymRange());
+
+            /** Sets the range of a symbolic integer returned by get_new_symbolic_integer() */
+            void set_symbolic_range(SymInt symbol, SymRange range);
+
+            /** The range of any polynomial of the symbolic integers, propagated from their ranges */
+            SymRange range_of(SymInt const &value) const;
+
+            /** The range of the number of elements of the node */
+            SymRange size_range(Node node) const;
+
+            /** The static cost of each node, by its id. Use OperatorCost::eval to get numbers for given shapes */
+            std::vector<OperatorCost> node_costs() const;
+
+            /** The cost of the nodes of each group, including those of its subgroups, by the full name of the group */
+            std::map<std::string, OperatorCost> group_costs() const;
+
+            /** The cost of all nodes of the graph */
+            OperatorCost total_cost() const;
+
+            /**
+             * Predicts the peak memory of computing the targets and the updates of the (optimized) graph.
+             * The values of the symbolic integers are given by their id, those missing take their likely value.
+             */
+            MemoryEstimate estimate_memory(NodeVec targets, std::vector<long long> values = {}) const;
 
             /** Returns the group specified by full_name. If it does not exist creates it. */
             Group get_group(std::string full_name);
@@ -584,6 +687,9 @@ namespace metadiff {
 
             /** Returns a Node wrapper around a shared variable */
             Node shared_variable(SharedPtr var, std::string name = "SharedVar");
+
+            /** Returns a Node wrapper around a shared variable in host memory */
+            Node shared_variable(kernels::HostArray value, std::string name = "SharedVar");
 #ifdef AFAPI
             /** Returns a Node wrapper around a shared variable */
             Node shared_variable(af::array value, std::string name = "SharedVar");
@@ -615,6 +721,12 @@ namespace metadiff {
             /** Returns a Node wrapper around the double value. */
             Node constant_value(double value, Shape shape = scalar_shape);
 
+            /**
+             * Returns a scalar hyperparameter with the initial value,
+             * which can be changed on the compiled functions by set_hyperparameter
+             */
+            Node hyperparameter(double value, std::string name = "Hyperparameter");
+
             Node wrap(Node value){
                 return value;
             }
@@ -324,6 +324,21 @@ namespace metadiff{
             return parents;
         }
 
+        OperatorCost Operator::cost() const {
+            return elementwise_cost(1);
+        }
+
+        OperatorCost Operator::elementwise_cost(long long flops, long long transcendentals) const {
+            NodeVec ancestors = get_ancestors();
+            SymInt read = 0;
+            for (size_t i = 0; i < ancestors.size(); i++) {
+                read = read + number_of_bytes(ancestors[i]->shape, ancestors[i]->dtype);
+            }
+            SymInt elements = number_of_elements(owner->shape);
+            return OperatorCost(elements * flops, read, number_of_bytes(owner->shape, owner->dtype),
+                                elements * transcendentals);
+        }
+
         Graph create_graph() {
             return std::make_shared<GraphInternal>();
         }
@@ -344,10 +359,13 @@ namespace metadiff{
             new_graph->default_device = default_device;
             new_graph->max_float = max_float;
             new_graph->max_int = max_int;
+            new_graph->precision = precision;
+            new_graph->profile_db = profile_db;
             new_graph->promote_type = promote_type;
             new_graph->broadcast_err_policy = broadcast_err_policy;
             new_graph->type_promotion_err_policy = type_promotion_err_policy;
             new_graph->sym_integer_count = sym_integer_count;
+            new_graph->sym_integer_ranges = sym_integer_ranges;
 //            new_graph->shared_vars = shared_vars;
             new_graph->groups = groups;
             size_t n = nodes.size();
@@ -519,6 +537,7 @@ namespace metadiff{
 
         std::vector<Node> GraphInternal::gradient(Node objective, std::vector<Node> params) {
             logger()->trace() << "Getting gradients of " << objective->id;
+            trace::Span span("gradient", "graph");
             // Stores the current group in order to recreate it
             Group old_group = current_group;
             if (not objective.is_scalar()) {
@@ -576,11 +595,73 @@ namespace metadiff{
             return grads;
         };
 
+        size_t GraphInternal::structural_hash() const {
+            std::stringstream structure;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                structure << nodes[i]->op->name << "(";
+                NodeVec ancestors = nodes[i]->op->get_ancestors();
+                for (size_t j = 0; j < ancestors.size(); j++) {
+                    structure << ancestors[j]->id << ",";
+                }
+                structure << ")";
+                for (size_t j = 0; j < 4; j++) {
+                    structure << nodes[i]->shape[j] << ",";
+                }
+                structure << nodes[i]->dtype << ";";
+            }
+            return std::hash<std::string>()(structure.str());
+        }
+
+        bool GraphInternal::load_profile() {
+            std::ifstream db(profile_db);
+            size_t hash = structural_hash();
+            size_t entry_hash, id;
+            double time;
+            long long bytes;
+            bool found = false;
+            while (db >> entry_hash >> id >> time >> bytes) {
+                if (entry_hash == hash and id < nodes.size()) {
+                    nodes[id]->execution.time = time;
+                    nodes[id]->execution.bytes = bytes;
+                    found = true;
+                }
+            }
+            return found;
+        }
+
+        void GraphInternal::save_profile() const {
+            // Keep the entries of all other graphs
+            std::stringstream entries;
+            std::ifstream db(profile_db);
+            size_t hash = structural_hash();
+            std::string line;
+            while (std::getline(db, line)) {
+                std::stringstream entry(line);
+                size_t entry_hash;
+                if (entry >> entry_hash and entry_hash != hash) {
+                    entries << line << "\n";
+                }
+            }
+            db.close();
+            for (size_t i = 0; i < nodes.size(); i++) {
+                if (nodes[i]->execution.time >= 0) {
+                    entries << hash << " " << i << " " << std::setprecision(9) << nodes[i]->execution.time
+                            << " " << nodes[i]->execution.bytes << "\n";
+                }
+            }
+            std::ofstream out(profile_db);
+            out << entries.str();
+            logger()->debug() << "Saved the profile of " << name << " to " << profile_db;
+        }
+
         // Copies the graph and optimizes it, populating the execution data
         Graph GraphInternal::optimize(NodeVec &targets, Updates &updates, NodeVec &inputs,
                                       NodeVec &new_targets, Updates &new_updates, NodeVec &new_inputs) {
             logger()->debug() << "Running optimization of graph " << name;
+            trace::Span span("optimize", "graph");
+            span.arg("graph", name);
             // Copy only the relevant part of the graph
+            trace::Span copy_span("optimize: copy", "graph");
             Graph copy = create_graph();
             add_temporary_updates(updates);
             NodeVec marked(targets.size() + this->updates.size() + this->temporary_updates.size());
@@ -596,7 +677,9 @@ namespace metadiff{
 
             NodeVec mapping = this->copy(copy.get(), get_ancestors_mask(marked));
             clear_temporary_updates();
+            copy_span.finish();
             // Optimize
+            trace::Span inline_span("optimize: inline", "graph");
             for (size_t i = 0; i < copy->nodes.size(); i++) {
                 Node node = copy->nodes[i];
                 if (node->op->name == "Input") {
@@ -621,6 +704,49 @@ namespace metadiff{
                     node->execution.inlined = true;
                 }
             }
+            inline_span.finish();
+            // Measured costs from earlier runs replace the heuristic based on the number of children.
+            // This only moves nodes from materialized to inlined, since the inlined ones are never computed
+            // on their own, thus never measured, and keep the decision of the heuristic.
+            trace::Span profile_span("optimize: measured inline", "graph");
+            if (copy->profile_db != "" and copy->load_profile()) {
+                logger()->debug() << "Using the measured costs of the nodes for inlining";
+                // The median over the measured nodes estimates the memory bandwidth, where the fastest one
+                // would be dominated by a single node whose result stayed in the cache
+                std::vector<double> bandwidths;
+                for (size_t i = 0; i < copy->nodes.size(); i++) {
+                    ExecutionData &execution = copy->nodes[i]->execution;
+                    if (execution.time > 0 and execution.bytes > 0) {
+                        bandwidths.push_back(execution.bytes / execution.time);
+                    }
+                }
+                double bandwidth = 0;
+                if (bandwidths.size() > 0) {
+                    std::nth_element(bandwidths.begin(), bandwidths.begin() + bandwidths.size() / 2, bandwidths.end());
+                    bandwidth = bandwidths[bandwidths.size() / 2];
+                }
+                for (size_t i = 0; i < copy->nodes.size(); i++) {
+                    Node node = copy->nodes[i];
+                    std::string op_name = node->op->name;
+                    if (op_name == "Input" or op_name == "Shared" or op_name == "Broadcast" or
+                        op_name == "Transpose" or op_name == "Neg" or (node.is_scalar() and node.is_constant()) or
+                        node->children.size() == 0 or node->execution.time < 0 or node->execution.bytes <= 0 or
+                        bandwidth == 0) {
+                        continue;
+                    }
+                    // Inlining computes the node again for every element of each of its children
+                    double computations = 0;
+                    for (size_t j = 0; j < node->children.size(); j++) {
+                        long long bytes = node->children[j]->execution.bytes;
+                        computations += std::max<double>(bytes, node->execution.bytes) / node->execution.bytes;
+                    }
+                    double recompute_time = node->execution.time * (computations - 1);
+                    // Otherwise its value is written once and read by each of its children
+                    double store_time = node->execution.bytes * (1.0 + node->children.size()) / bandwidth;
+                    node->execution.inlined = recompute_time <= store_time;
+                }
+            }
+            profile_span.finish();
             // Set the new_targets and new_updates
             for (int i = 0; i < targets.size(); i++) {
                 new_targets.push_back(mapping[targets[i]->id]);
@@ -770,9 +896,162 @@ namespace metadiff{
 //        return result;
 //    };
 
-        SymInt GraphInternal::get_new_symbolic_integer() {
+        SymInt GraphInternal::get_new_symbolic_integer(SymRange range) {
             this->sym_integer_count++;
-            return SymInt::variable(this->sym_integer_count - 1);
+            SymInt symbol = SymInt::variable(this->sym_integer_count - 1);
+            set_symbolic_range(symbol, range);
+            return symbol;
+        }
+
+        void GraphInternal::set_symbolic_range(SymInt symbol, SymRange range) {
+            if (symbol.monomials.size() != 1 or symbol.monomials[0].coefficient != 1 or
+                symbol.monomials[0].powers.size() != 1 or symbol.monomials[0].powers[0].second != 1 or
+                symbol.monomials[0].powers[0].first >= sym_integer_count) {
+                auto err = OtherError(NodeVec{}, "The range can only be set for symbolic integers of the graph, "
+                        "but was given " + symbol.to_string());
+                logger()->error() << err.msg;
+                throw err;
+            }
+            if (range.min > range.max or not range.contains(range.likely)) {
+                auto err = OtherError(NodeVec{}, "Invalid range for symbolic integer " + symbol.to_string());
+                logger()->error() << err.msg;
+                throw err;
+            }
+            sym_integer_ranges.resize(sym_integer_count);
+            sym_integer_ranges[symbol.monomials[0].powers[0].first] = range;
+        }
+
+        SymRange GraphInternal::range_of(SymInt const &value) const {
+            return symbolic::range(value, sym_integer_ranges);
+        }
+
+        SymRange GraphInternal::size_range(Node node) const {
+            return range_of(node->shape[0] * node->shape[1] * node->shape[2] * node->shape[3]);
+        }
+
+        std::vector<OperatorCost> GraphInternal::node_costs() const {
+            std::vector<OperatorCost> costs;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                costs.push_back(nodes[i]->op->cost());
+            }
+            return costs;
+        }
+
+        std::map<std::string, OperatorCost> GraphInternal::group_costs() const {
+            std::vector<OperatorCost> costs = node_costs();
+            std::map<std::string, OperatorCost> result;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                std::shared_ptr<NodeGroup> group = nodes[i]->group.lock();
+                while (group) {
+                    result[group->full_name] += costs[i];
+                    group = group->parent.lock();
+                }
+            }
+            return result;
+        }
+
+        MemoryEstimate GraphInternal::estimate_memory(NodeVec targets, std::vector<long long> values) const {
+            for (size_t i = values.size(); i < sym_integer_count; i++) {
+                values.push_back(i < sym_integer_ranges.size() ? sym_integer_ranges[i].likely : 1);
+            }
+            size_t n = nodes.size();
+            // Targets and the values of updates are held until the end
+            std::vector<size_t> last_use(n, 0);
+            std::vector<bool> held(n, false);
+            for (size_t i = 0; i < targets.size(); i++) {
+                last_use[targets[i]->id] = n;
+                held[targets[i]->id] = true;
+            }
+            std::vector<Updates const *> all_updates{&updates, &temporary_updates};
+            for (size_t u = 0; u < all_updates.size(); u++) {
+                for (size_t i = 0; i < all_updates[u]->size(); i++) {
+                    last_use[(*all_updates[u])[i].second->id] = n;
+                    held[(*all_updates[u])[i].second->id] = true;
+                }
+            }
+            // A node is needed until its last child is computed. Inlined nodes and views have no buffer of
+            // their own, so their operands are needed until the last use of the node instead.
+            // The held ones are always written to an array, even when inlined.
+            std::vector<bool> view(n, false);
+            std::vector<bool> backward_use(n, false);
+            for (size_t i = n; i-- > 0;) {
+                std::string op_name = nodes[i]->op->name;
+                bool leaf = op_name == "Input" or op_name == "Shared";
+                view[i] = (nodes[i]->execution.inlined and not leaf and not held[i]) or
+                          op_name == "Alias" or op_name == "Reshape";
+                for (size_t j = 0; j < nodes[i]->children.size(); j++) {
+                    Node child = nodes[i]->children[j];
+                    last_use[i] = std::max(last_use[i], child->id);
+                    backward_use[i] = backward_use[i] or child->grad_level > 0;
+                }
+                if (view[i]) {
+                    NodeVec ancestors = nodes[i]->op->get_ancestors();
+                    for (size_t j = 0; j < ancestors.size(); j++) {
+                        last_use[ancestors[j]->id] = std::max(last_use[ancestors[j]->id], last_use[i]);
+                    }
+                }
+            }
+            // Inputs are provided before the first node is computed, the rest are allocated by their computation
+            MemoryEstimate estimate;
+            std::vector<long long> bytes(n, 0);
+            std::vector<size_t> first(n, 0);
+            std::vector<std::vector<size_t>> freed(n + 1);
+            for (size_t i = 0; i < n; i++) {
+                std::string op_name = nodes[i]->op->name;
+                if (not view[i]) {
+                    bytes[i] = number_of_bytes(nodes[i]->shape, nodes[i]->dtype).eval(values);
+                }
+                if (op_name == "Shared") {
+                    estimate.parameters += bytes[i];
+                    bytes[i] = 0;
+                }
+                first[i] = op_name == "Input" ? 0 : i;
+                last_use[i] = std::max(last_use[i], first[i]);
+                freed[last_use[i]].push_back(i);
+            }
+            long long live = 0;
+            for (size_t i = 0; i < n; i++) {
+                live += first[i] == 0 ? bytes[i] : 0;
+            }
+            long long peak = -1;
+            for (size_t i = 0; i < n; i++) {
+                live += first[i] > 0 ? bytes[i] : 0;
+                if (live > peak) {
+                    peak = live;
+                    estimate.peak_node = i;
+                }
+                for (size_t j = 0; j < freed[i].size(); j++) {
+                    live -= bytes[freed[i][j]];
+                }
+            }
+            // Break down the nodes live while the peak node is computed
+            for (size_t i = 0; i < n; i++) {
+                if (bytes[i] == 0 or first[i] > estimate.peak_node or last_use[i] < estimate.peak_node) {
+                    continue;
+                }
+                if (nodes[i]->grad_level > 0) {
+                    estimate.gradients += bytes[i];
+                } else if (backward_use[i]) {
+                    estimate.activations += bytes[i];
+                } else {
+                    estimate.temporaries += bytes[i];
+                }
+                estimate.contributors.push_back({i, bytes[i]});
+            }
+            std::sort(estimate.contributors.begin(), estimate.contributors.end(),
+                      [](std::pair<size_t, long long> const &a, std::pair<size_t, long long> const &b) {
+                          return a.second > b.second;
+                      });
+            return estimate;
+        }
+
+        OperatorCost GraphInternal::total_cost() const {
+            std::vector<OperatorCost> costs = node_costs();
+            OperatorCost total;
+            for (size_t i = 0; i < costs.size(); i++) {
+                total += costs[i];
+            }
+            return total;
         }
 
         Group GraphInternal::get_group(std::string full_name) {
@@ -85,6 +85,14 @@ namespace metadiff{
                     RAISE = 2
         };
 
+        /** The accuracy of the transcendental functions (exp, log, tanh...) used by the backends */
+        enum mathPrecision {
+            /** Accurate to about 1 ulp, with correct handling of all special values */
+                    PRECISE = 0,
+            /** Shorter approximations with a relative error of about 1e-5 */
+                    FAST = 1
+        };
+
         /**
          * A single computational device to facilitate multy node computations
          * TODO not yet well designed, high probability it will change in the future
@@ -129,17 +137,26 @@ namespace metadiff{
              * which the node can be destroyed
              */
             size_t lifespan;
+            /** The measured mean time in seconds to compute the node, negative when it has not been measured */
+            double time;
+            /** The measured size in bytes of the value of the node, negative when it has not been measured */
+            long long bytes;
 
             ExecutionData() :
                     inlined(false),
                     inplace(false),
                     register_id(0),
-                    lifespan(0) { };
+                    lifespan(0),
+                    time(-1),
+                    bytes(-1) { };
 
             ExecutionData(ExecutionData const &data) :
                     inlined(data.inlined),
+                    inplace(data.inplace),
                     register_id(data.register_id),
-                    lifespan(data.lifespan) { };
+                    lifespan(data.lifespan),
+                    time(data.time),
+                    bytes(data.bytes) { };
         };
 
         /**
@@ -184,6 +201,8 @@ namespace metadiff{
         typedef std::vector<short> Axes;
         /** A symbolic integer is just a SymbolicPolynomial */
         typedef symbolic::SymbolicPolynomial<unsigned short, unsigned short> SymInt;
+        /** The values a symbolic integer can take */
+        typedef symbolic::SymbolicRange SymRange;
         /**
         * The shape of any variable.
         * Currently we support 4 dimensional tensors.
@@ -192,6 +211,51 @@ namespace metadiff{
         typedef std::array<SymInt, 4> Shape;
         static const Shape scalar_shape = Shape{SymInt::one, SymInt::one, SymInt::one, SymInt::one};
 
+        /**
+         * A static estimate of the work done by an operator, as polynomials of the symbolic integers
+         * of the shapes. Transcendental functions are counted separately from the arithmetic flops.
+         */
+        class OperatorCost {
+        public:
+            SymInt flops;
+            SymInt bytes_read;
+            SymInt bytes_written;
+            SymInt transcendentals;
+
+            OperatorCost() {};
+
+            OperatorCost(SymInt flops, SymInt bytes_read, SymInt bytes_written, SymInt transcendentals = 0):
+                    flops(flops),
+                    bytes_read(bytes_read),
+                    bytes_written(bytes_written),
+                    transcendentals(transcendentals) {};
+
+            OperatorCost &operator+=(OperatorCost const &other) {
+                flops = flops + other.flops;
+                bytes_read = bytes_read + other.bytes_read;
+                bytes_written = bytes_written + other.bytes_written;
+                transcendentals = transcendentals + other.transcendentals;
+                return *this;
+            }
+
+            /** The cost with every symbolic integer bound to the value given for its id */
+            OperatorCost eval(std::vector<long long> const &values) const {
+                return OperatorCost(flops.eval(values), bytes_read.eval(values), bytes_written.eval(values),
+                                    transcendentals.eval(values));
+            }
+
+            /** Flops per byte moved, the x axis of a roofline plot. Valid only for an evaluated cost */
+            double arithmetic_intensity() const {
+                long long bytes = bytes_read.constant_value() + bytes_written.constant_value();
+                return bytes == 0 ? 0 : double(flops.constant_value()) / double(bytes);
+            }
+        };
+
+        inline OperatorCost operator+(OperatorCost lhs, OperatorCost const &rhs) {
+            lhs += rhs;
+            return lhs;
+        }
+
         /** A group is a weak_ptr to internal Group */
         typedef std::weak_ptr<core::NodeGroup> Group;
         class GraphInternal;
@@ -269,6 +333,26 @@ namespace metadiff{
             return f;
         }
 
+        /** The size in bytes of a single element of the type */
+        size_t byte_size(dType dType) {
+            switch (dType) {
+                case b8: case u8: case i8: case f8:
+                    return 1;
+                case u16: case i16: case f16:
+                    return 2;
+                case u32: case i32: case f32:
+                    return 4;
+                default:
+                    return 8;
+            }
+        }
+
+        std::ostream &operator<<(std::ostream &f, OperatorCost const &cost) {
+            f << "flops: " << cost.flops << ", bytes read: " << cost.bytes_read << ", bytes written: "
+              << cost.bytes_written << ", transcendentals: " << cost.transcendentals;
+            return f;
+        }
+
         std::string to_string(deviceType type) {
             switch (type) {
                 case HOST:
@@ -303,6 +387,22 @@ namespace metadiff{
             return f;
         }
 
+        std::string to_string(mathPrecision precision) {
+            switch (precision) {
+                case PRECISE:
+                    return "Precise";
+                case FAST:
+                    return "Fast";
+                default:
+                    return "UNREACHABLE";
+            }
+        }
+
+        std::ostream &operator<<(std::ostream &f, mathPrecision precision) {
+            f << to_string(precision);
+            return f;
+        }
+
         std::string to_string(Device const &device) {
             return to_string(device.type) + "[" + std::to_string(device.id) + "]";
         }
@@ -162,6 +162,20 @@ namespace metadiff{
             }
         };
 
+        class MemoryLimitExceeded : public std::exception {
+        public:
+            std::string msg;
+            MemoryLimitExceeded(): msg("") {};
+
+            MemoryLimitExceeded(long long limit, std::string report) :
+                    msg("The function is predicted to exceed the memory limit of " + std::to_string(limit) +
+                        " bytes. " + report) {};
+
+            const char *what() const throw() {
+                return msg.c_str();
+            }
+        };
+
         class InvalidInputShape : public std::exception {
         private:
             std::string generate_message(){
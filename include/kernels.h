@@ -0,0 +1,13 @@
+//
+// Created by alex on 14/10/16.
+//
+
+#ifndef METADIFF_KERNELS_H
+#define METADIFF_KERNELS_H
+
+#include "kernels/array.h"
+#include "kernels/base.h"
+#include "kernels/gemm.h"
+#include "kernels/vmath.h"
+
+#endif //METADIFF_KERNELS_H
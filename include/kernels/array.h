@@ -0,0 +1,183 @@
+//
+// Created by alex on 14/10/16.
+//
+
+#ifndef METADIFF_KERNELS_ARRAY_H
+#define METADIFF_KERNELS_ARRAY_H
+
+// The kernels are also included by the generated sources,
+// hence this header must not depend on the rest of the library
+#include <array>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace metadiff{
+    namespace kernels{
+        /** Alignment in bytes of all buffers allocated for a HostArray */
+        static size_t const HOST_ALIGNMENT = 64;
+
+        /** Dimensions of a HostArray */
+        typedef std::array<long long, 4> HostDims;
+
+        /** Allocates an aligned float buffer, which is released when the last reference to it is dropped */
+        inline std::shared_ptr<float> host_alloc(long long elements) {
+            void *ptr = nullptr;
+            size_t bytes = (size_t) (elements > 0 ? elements : 1) * sizeof(float);
+            if (posix_memalign(&ptr, HOST_ALIGNMENT, bytes) != 0) {
+                throw std::bad_alloc();
+            }
+            return std::shared_ptr<float>((float *) ptr, free);
+        }
+
+        /**
+         * A dense four dimensional f32 tensor in host memory.
+         * The data is stored in column major order, exactly as in af::array.
+         * The buffer is shared between copies, thus copying a HostArray is cheap
+         * and the views returned by reshape() alias the same memory.
+         */
+        class HostArray {
+        public:
+            /** The size of each dimension */
+            HostDims dims;
+            /** Owner of the memory, empty when the array wraps an external buffer */
+            std::shared_ptr<float> buffer;
+            /** Pointer to the first element */
+            float *data;
+
+            HostArray() :
+                    dims({{0, 0, 0, 0}}),
+                    data(nullptr) { };
+
+            HostArray(HostDims dims) :
+                    dims(dims),
+                    buffer(host_alloc(dims[0] * dims[1] * dims[2] * dims[3])) {
+                data = buffer.get();
+            };
+
+            HostArray(long long dim0, long long dim1 = 1, long long dim2 = 1, long long dim3 = 1) :
+                    HostArray(HostDims{{dim0, dim1, dim2, dim3}}) { };
+
+            /** Creates an array over an external buffer, without taking ownership of it */
+            static HostArray wrap(float *data, HostDims dims) {
+                HostArray result;
+                result.dims = dims;
+                result.data = data;
+                return result;
+            }
+
+            /** Creates a new array of the given dimensions with all elements set to value */
+            static HostArray constant(float value, HostDims dims) {
+                HostArray result(dims);
+                result.fill(value);
+                return result;
+            }
+
+            long long elements() const {
+                return dims[0] * dims[1] * dims[2] * dims[3];
+            }
+
+            bool is_scalar() const {
+                return elements() == 1;
+            }
+
+            float &operator[](long long index) {
+                return data[index];
+            }
+
+            float const &operator[](long long index) const {
+                return data[index];
+            }
+
+            /** Returns a view of the same data with different dimensions */
+            HostArray reshape(HostDims new_dims) const {
+                HostArray result = *this;
+                result.dims = new_dims;
+                return result;
+            }
+
+            /** Returns a deep copy of the array */
+            HostArray copy() const {
+                HostArray result(dims);
+                std::memcpy(result.data, data, (size_t) elements() * sizeof(float));
+                return result;
+            }
+
+            void fill(float value) {
+                long long n = elements();
+                for (long long i = 0; i < n; i++) {
+                    data[i] = value;
+                }
+            }
+        };
+
+        /**
+         * Allocates the array for the dimensions, unless it is already bound to a buffer
+         * with exactly these dimensions, which is then used as it is
+         */
+        inline void prepare(HostArray &array, HostDims const &dims) {
+            if (array.data == nullptr or array.dims != dims) {
+                array = HostArray(dims);
+            }
+        }
+
+        /** Copies the values of source to the buffer of destination, which must have the same number of elements */
+        inline void assign(HostArray &destination, HostArray const &source) {
+            if (destination.data == source.data) {
+                return;
+            }
+            if (destination.elements() != source.elements()) {
+                throw std::length_error("The output buffer has " + std::to_string(destination.elements()) +
+                                        " elements, while the result has " + std::to_string(source.elements()));
+            }
+            std::memcpy(destination.data, source.data, (size_t) source.elements() * sizeof(float));
+        }
+
+        /** Adds the values of source to total, which is allocated with the dimensions of source when empty */
+        inline void accumulate(HostArray &total, HostArray const &source) {
+            if (total.data == nullptr) {
+                total = HostArray(source.dims);
+                std::memset(total.data, 0, (size_t) total.elements() * sizeof(float));
+            }
+            if (total.elements() != source.elements()) {
+                throw std::length_error("The accumulated array has " + std::to_string(total.elements()) +
+                                        " elements, while the result has " + std::to_string(source.elements()));
+            }
+            long long n = source.elements();
+            float *out = total.data;
+            float const *in = source.data;
+            for (long long i = 0; i < n; i++) {
+                out[i] += in[i];
+            }
+        }
+
+        /**
+         * Maps a linear index of an array with dimensions out_dims to the linear index
+         * of an array with dimensions in_dims, which is broadcasted along its unit dimensions
+         */
+        inline long long broadcast_index(long long index, HostDims const &out_dims, HostDims const &in_dims) {
+            // Column vector broadcasted along the columns, the most common case
+            if (in_dims[1] == 1 and in_dims[2] == 1 and in_dims[3] == 1) {
+                return in_dims[0] == 1 ? 0 : index % out_dims[0];
+            }
+            // Row vector broadcasted along the rows
+            if (in_dims[0] == 1 and in_dims[2] == 1 and in_dims[3] == 1) {
+                return (index / out_dims[0]) % out_dims[1];
+            }
+            long long result = 0;
+            long long stride = 1;
+            for (int i = 0; i < 4; i++) {
+                long long coordinate = index % out_dims[i];
+                index /= out_dims[i];
+                if (in_dims[i] != 1) {
+                    result += coordinate * stride;
+                }
+                stride *= in_dims[i];
+            }
+            return result;
+        }
+    }
+}
+#endif //METADIFF_KERNELS_ARRAY_H
@@ -0,0 +1,95 @@
+//
+// Created by alex on 14/10/16.
+//
+
+#ifndef METADIFF_KERNELS_BASE_H
+#define METADIFF_KERNELS_BASE_H
+
+#include <vector>
+#include <algorithm>
+
+namespace metadiff{
+    namespace kernels{
+        /** Block size used for the cache friendly transpose */
+        static long long const TRANSPOSE_BLOCK = 32;
+
+        /** Sums all of the elements of the array */
+        inline HostArray sum(HostArray const &a) {
+            long long n = a.elements();
+            float const *data = a.data;
+            float total = 0;
+#pragma omp parallel for simd reduction(+:total) if(n > 65536)
+            for (long long i = 0; i < n; i++) {
+                total += data[i];
+            }
+            HostArray result(1);
+            result[0] = total;
+            return result;
+        }
+
+        /** Sums the array along all of the given axes */
+        inline HostArray sum(HostArray const &a, std::vector<short> const &axes) {
+            HostDims dims = a.dims;
+            bool reduce[4] = {false, false, false, false};
+            for (size_t i = 0; i < axes.size(); i++) {
+                reduce[axes[i]] = true;
+                dims[axes[i]] = 1;
+            }
+            HostArray result = HostArray::constant(0, dims);
+            // Strides of the result, which are zero along the summed axes
+            long long strides[4];
+            long long stride = 1;
+            for (int i = 0; i < 4; i++) {
+                strides[i] = reduce[i] ? 0 : stride;
+                stride *= dims[i];
+            }
+            float const *in = a.data;
+            float *out = result.data;
+            for (long long i3 = 0; i3 < a.dims[3]; i3++) {
+                for (long long i2 = 0; i2 < a.dims[2]; i2++) {
+                    for (long long i1 = 0; i1 < a.dims[1]; i1++) {
+                        float *out_col = out + i1 * strides[1] + i2 * strides[2] + i3 * strides[3];
+                        if (reduce[0]) {
+                            float total = 0;
+#pragma omp simd reduction(+:total)
+                            for (long long i0 = 0; i0 < a.dims[0]; i0++) {
+                                total += in[i0];
+                            }
+                            out_col[0] += total;
+                        } else {
+#pragma omp simd
+                            for (long long i0 = 0; i0 < a.dims[0]; i0++) {
+                                out_col[i0] += in[i0];
+                            }
+                        }
+                        in += a.dims[0];
+                    }
+                }
+            }
+            return result;
+        }
+
+        /** Transposes the first two dimensions of a matrix */
+        inline HostArray transpose(HostArray const &a) {
+            long long rows = a.dims[0];
+            long long cols = a.dims[1];
+            HostArray result(cols, rows);
+            float const *in = a.data;
+            float *out = result.data;
+#pragma omp parallel for if(rows * cols > 65536)
+            for (long long jb = 0; jb < cols; jb += TRANSPOSE_BLOCK) {
+                for (long long ib = 0; ib < rows; ib += TRANSPOSE_BLOCK) {
+                    long long j_end = std::min(jb + TRANSPOSE_BLOCK, cols);
+                    long long i_end = std::min(ib + TRANSPOSE_BLOCK, rows);
+                    for (long long j = jb; j < j_end; j++) {
+                        for (long long i = ib; i < i_end; i++) {
+                            out[j + i * cols] = in[i + j * rows];
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+    }
+}
+#endif //METADIFF_KERNELS_BASE_H
@@ -0,0 +1,283 @@
+//
+// Created by alex on 14/10/16.
+//
+
+#ifndef METADIFF_KERNELS_GEMM_H
+#define METADIFF_KERNELS_GEMM_H
+
+#include <algorithm>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace metadiff{
+    namespace kernels{
+        /**
+         * Blocking parameters of the GEMM.
+         * The micro tile of C is GEMM_MR x GEMM_NR and lives entirely in vector registers.
+         * A block of GEMM_MC x GEMM_KC of A is packed to stay in the L2 cache,
+         * while a GEMM_KC x GEMM_NC block of B is packed to stay in the L3 cache.
+         * The micro kernel is selected by the instruction set the code is compiled for.
+         */
+#if defined(__AVX512F__)
+        static long long const GEMM_MR = 32;
+        static long long const GEMM_NR = 8;
+#elif defined(__AVX2__) and defined(__FMA__)
+        static long long const GEMM_MR = 16;
+        static long long const GEMM_NR = 6;
+#elif defined(__SSE2__)
+        static long long const GEMM_MR = 8;
+        static long long const GEMM_NR = 4;
+#else
+        static long long const GEMM_MR = 4;
+        static long long const GEMM_NR = 4;
+#endif
+        static long long const GEMM_KC = 256;
+        static long long const GEMM_MC = 128;
+        static long long const GEMM_NC = 3072;
+        /** Products with fewer multiply-adds than this are computed on a single thread */
+        static long long const GEMM_PARALLEL_THRESHOLD = 64 * 64 * 64;
+
+        /**
+         * Computes C += A * B for a single GEMM_MR x GEMM_NR tile, where A and B are packed panels.
+         * The packed A contains GEMM_MR consecutive elements for each k,
+         * while the packed B contains GEMM_NR consecutive elements for each k.
+         */
+        inline void gemm_micro_kernel(long long kc, float const *a, float const *b, float *c, long long ldc) {
+#if defined(__AVX512F__)
+            __m512 c0[GEMM_NR], c1[GEMM_NR];
+            for (int j = 0; j < GEMM_NR; j++) {
+                c0[j] = _mm512_loadu_ps(c + j * ldc);
+                c1[j] = _mm512_loadu_ps(c + j * ldc + 16);
+            }
+            for (long long p = 0; p < kc; p++) {
+                __m512 a0 = _mm512_load_ps(a);
+                __m512 a1 = _mm512_load_ps(a + 16);
+                for (int j = 0; j < GEMM_NR; j++) {
+                    __m512 bj = _mm512_set1_ps(b[j]);
+                    c0[j] = _mm512_fmadd_ps(a0, bj, c0[j]);
+                    c1[j] = _mm512_fmadd_ps(a1, bj, c1[j]);
+                }
+                a += GEMM_MR;
+                b += GEMM_NR;
+            }
+            for (int j = 0; j < GEMM_NR; j++) {
+                _mm512_storeu_ps(c + j * ldc, c0[j]);
+                _mm512_storeu_ps(c + j * ldc + 16, c1[j]);
+            }
+#elif defined(__AVX2__) and defined(__FMA__)
+            __m256 c0[GEMM_NR], c1[GEMM_NR];
+            for (int j = 0; j < GEMM_NR; j++) {
+                c0[j] = _mm256_loadu_ps(c + j * ldc);
+                c1[j] = _mm256_loadu_ps(c + j * ldc + 8);
+            }
+            for (long long p = 0; p < kc; p++) {
+                __m256 a0 = _mm256_load_ps(a);
+                __m256 a1 = _mm256_load_ps(a + 8);
+                for (int j = 0; j < GEMM_NR; j++) {
+                    __m256 bj = _mm256_broadcast_ss(b + j);
+                    c0[j] = _mm256_fmadd_ps(a0, bj, c0[j]);
+                    c1[j] = _mm256_fmadd_ps(a1, bj, c1[j]);
+                }
+                a += GEMM_MR;
+                b += GEMM_NR;
+            }
+            for (int j = 0; j < GEMM_NR; j++) {
+                _mm256_storeu_ps(c + j * ldc, c0[j]);
+                _mm256_storeu_ps(c + j * ldc + 8, c1[j]);
+            }
+#elif defined(__SSE2__)
+            __m128 c0[GEMM_NR], c1[GEMM_NR];
+            for (int j = 0; j < GEMM_NR; j++) {
+                c0[j] = _mm_loadu_ps(c + j * ldc);
+                c1[j] = _mm_loadu_ps(c + j * ldc + 4);
+            }
+            for (long long p = 0; p < kc; p++) {
+                __m128 a0 = _mm_load_ps(a);
+                __m128 a1 = _mm_load_ps(a + 4);
+                for (int j = 0; j < GEMM_NR; j++) {
+                    __m128 bj = _mm_set1_ps(b[j]);
+                    c0[j] = _mm_add_ps(c0[j], _mm_mul_ps(a0, bj));
+                    c1[j] = _mm_add_ps(c1[j], _mm_mul_ps(a1, bj));
+                }
+                a += GEMM_MR;
+                b += GEMM_NR;
+            }
+            for (int j = 0; j < GEMM_NR; j++) {
+                _mm_storeu_ps(c + j * ldc, c0[j]);
+                _mm_storeu_ps(c + j * ldc + 4, c1[j]);
+            }
+#else
+            float acc[GEMM_NR][GEMM_MR];
+            for (int j = 0; j < GEMM_NR; j++) {
+                for (int i = 0; i < GEMM_MR; i++) {
+                    acc[j][i] = c[i + j * ldc];
+                }
+            }
+            for (long long p = 0; p < kc; p++) {
+                for (int j = 0; j < GEMM_NR; j++) {
+                    for (int i = 0; i < GEMM_MR; i++) {
+                        acc[j][i] += a[i] * b[j];
+                    }
+                }
+                a += GEMM_MR;
+                b += GEMM_NR;
+            }
+            for (int j = 0; j < GEMM_NR; j++) {
+                for (int i = 0; i < GEMM_MR; i++) {
+                    c[i + j * ldc] = acc[j][i];
+                }
+            }
+#endif
+        }
+
+        /**
+         * Packs the mc x kc block of op(A) starting at a into panels of GEMM_MR rows,
+         * scaling by alpha and padding the last panel with zeros
+         */
+        inline void gemm_pack_a(bool trans, long long panel, long long mc, long long kc,
+                                float alpha, float const *a, long long lda, float *packed) {
+            long long i0 = panel * GEMM_MR;
+            long long mr = std::min(GEMM_MR, mc - i0);
+            packed += panel * GEMM_MR * kc;
+            for (long long p = 0; p < kc; p++) {
+                for (long long i = 0; i < mr; i++) {
+                    long long index = trans ? p + (i0 + i) * lda : (i0 + i) + p * lda;
+                    packed[i] = alpha * a[index];
+                }
+                for (long long i = mr; i < GEMM_MR; i++) {
+                    packed[i] = 0;
+                }
+                packed += GEMM_MR;
+            }
+        }
+
+        /**
+         * Packs the kc x nc block of op(B) starting at b into panels of GEMM_NR columns,
+         * padding the last panel with zeros
+         */
+        inline void gemm_pack_b(bool trans, long long panel, long long kc, long long nc,
+                                float const *b, long long ldb, float *packed) {
+            long long j0 = panel * GEMM_NR;
+            long long nr = std::min(GEMM_NR, nc - j0);
+            packed += panel * GEMM_NR * kc;
+            for (long long p = 0; p < kc; p++) {
+                for (long long j = 0; j < nr; j++) {
+                    long long index = trans ? (j0 + j) + p * ldb : p + (j0 + j) * ldb;
+                    packed[j] = b[index];
+                }
+                for (long long j = nr; j < GEMM_NR; j++) {
+                    packed[j] = 0;
+                }
+                packed += GEMM_NR;
+            }
+        }
+
+        /**
+         * Computes C = alpha * op(A) * op(B) + beta * C, where op(X) is X or its transpose.
+         * All matrices are in column major order, following the BLAS sgemm convention,
+         * thus op(A) is m x k, op(B) is k x n and C is m x n.
+         * The loops are blocked and the operands are packed so that each micro kernel
+         * streams through contiguous memory. The tiles of C within a block are
+         * distributed over the OpenMP threads.
+         */
+        inline void gemm(bool trans_a, bool trans_b,
+                         long long m, long long n, long long k,
+                         float alpha, float const *a, long long lda,
+                         float const *b, long long ldb,
+                         float beta, float *c, long long ldc) {
+            if (m <= 0 or n <= 0) {
+                return;
+            }
+            // Apply beta to C, ignoring its contents when beta is zero
+            if (beta != 1) {
+                for (long long j = 0; j < n; j++) {
+                    for (long long i = 0; i < m; i++) {
+                        c[i + j * ldc] = beta == 0 ? 0 : beta * c[i + j * ldc];
+                    }
+                }
+            }
+            if (k <= 0 or alpha == 0) {
+                return;
+            }
+            long long mc_max = std::min(GEMM_MC, (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR);
+            long long nc_max = std::min(GEMM_NC, (n + GEMM_NR - 1) / GEMM_NR * GEMM_NR);
+            long long kc_max = std::min(GEMM_KC, k);
+            std::shared_ptr<float> packed_a = host_alloc(mc_max * kc_max);
+            std::shared_ptr<float> packed_b = host_alloc(kc_max * nc_max);
+            float *pa = packed_a.get();
+            float *pb = packed_b.get();
+            bool parallel = m * n * k >= GEMM_PARALLEL_THRESHOLD;
+#pragma omp parallel if(parallel)
+            for (long long jc = 0; jc < n; jc += GEMM_NC) {
+                long long nc = std::min(GEMM_NC, n - jc);
+                long long n_panels = (nc + GEMM_NR - 1) / GEMM_NR;
+                for (long long pc = 0; pc < k; pc += GEMM_KC) {
+                    long long kc = std::min(GEMM_KC, k - pc);
+                    float const *b_block = trans_b ? b + jc + pc * ldb : b + pc + jc * ldb;
+#pragma omp for schedule(static)
+                    for (long long jr = 0; jr < n_panels; jr++) {
+                        gemm_pack_b(trans_b, jr, kc, nc, b_block, ldb, pb);
+                    }
+                    for (long long ic = 0; ic < m; ic += GEMM_MC) {
+                        long long mc = std::min(GEMM_MC, m - ic);
+                        long long m_panels = (mc + GEMM_MR - 1) / GEMM_MR;
+                        float const *a_block = trans_a ? a + pc + ic * lda : a + ic + pc * lda;
+#pragma omp for schedule(static)
+                        for (long long ir = 0; ir < m_panels; ir++) {
+                            gemm_pack_a(trans_a, ir, mc, kc, alpha, a_block, lda, pa);
+                        }
+                        // Each tile of the C block is independent
+#pragma omp for collapse(2) schedule(static)
+                        for (long long jr = 0; jr < n_panels; jr++) {
+                            for (long long ir = 0; ir < m_panels; ir++) {
+                                long long mr = std::min(GEMM_MR, mc - ir * GEMM_MR);
+                                long long nr = std::min(GEMM_NR, nc - jr * GEMM_NR);
+                                float *c_tile = c + (ic + ir * GEMM_MR) + (jc + jr * GEMM_NR) * ldc;
+                                float const *a_panel = pa + ir * GEMM_MR * kc;
+                                float const *b_panel = pb + jr * GEMM_NR * kc;
+                                if (mr == GEMM_MR and nr == GEMM_NR) {
+                                    gemm_micro_kernel(kc, a_panel, b_panel, c_tile, ldc);
+                                } else {
+                                    // Edge tiles are computed in a local buffer
+                                    float tile[GEMM_MR * GEMM_NR] = {};
+                                    gemm_micro_kernel(kc, a_panel, b_panel, tile, GEMM_MR);
+                                    for (long long j = 0; j < nr; j++) {
+                                        for (long long i = 0; i < mr; i++) {
+                                            c_tile[i + j * ldc] += tile[i + j * GEMM_MR];
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        /**
+         * Matrix product of two matrices, where either of them can be transposed.
+         * This is the equivalent of af::matmul with AF_MAT_NONE/AF_MAT_TRANS flags.
+         */
+        inline HostArray matmul(HostArray const &a, HostArray const &b,
+                                bool trans_a = false, bool trans_b = false) {
+            long long m = trans_a ? a.dims[1] : a.dims[0];
+            long long k = trans_a ? a.dims[0] : a.dims[1];
+            long long n = trans_b ? b.dims[0] : b.dims[1];
+            HostArray result(m, n);
+            gemm(trans_a, trans_b, m, n, k, 1.0f, a.data, a.dims[0], b.data, b.dims[0], 0.0f, result.data, m);
+            return result;
+        }
+
+        /** Same as matmul, but writes the product to the buffer of result if it has the right dimensions */
+        inline void matmul_into(HostArray &result, HostArray const &a, HostArray const &b,
+                                bool trans_a = false, bool trans_b = false) {
+            long long m = trans_a ? a.dims[1] : a.dims[0];
+            long long k = trans_a ? a.dims[0] : a.dims[1];
+            long long n = trans_b ? b.dims[0] : b.dims[1];
+            prepare(result, HostDims{{m, n, 1, 1}});
+            gemm(trans_a, trans_b, m, n, k, 1.0f, a.data, a.dims[0], b.data, b.dims[0], 0.0f, result.data, m);
+        }
+    }
+}
+#endif //METADIFF_KERNELS_GEMM_H
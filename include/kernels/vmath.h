@@ -0,0 +1,185 @@
+//
+// Created by alex on 15/10/16.
+//
+
+#ifndef METADIFF_KERNELS_VMATH_H
+#define METADIFF_KERNELS_VMATH_H
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace metadiff{
+    namespace kernels{
+        /**
+         * Branch free implementations of the transcendental functions, which the compiler
+         * can vectorize inside of `omp simd` loops, unlike the scalar calls to libm.
+         * The functions in vmath are accurate to about 1 ulp and handle all special values,
+         * while those in vmath::fast use shorter polynomials and have a relative error of about 1e-5.
+         * The selects are vectorized only when compiled with -fno-trapping-math.
+         */
+        namespace vmath{
+            static float const INF = std::numeric_limits<float>::infinity();
+            static float const NOT_A_NUMBER = std::numeric_limits<float>::quiet_NaN();
+
+            inline int32_t float_bits(float x) {
+                int32_t bits;
+                std::memcpy(&bits, &x, sizeof(float));
+                return bits;
+            }
+
+            inline float bits_float(int32_t bits) {
+                float x;
+                std::memcpy(&x, &bits, sizeof(float));
+                return x;
+            }
+
+            /** Rounds to the nearest integer, valid for |x| < 2^22 */
+            inline float round_nearest(float x) {
+                return (x + 12582912.0f) - 12582912.0f;
+            }
+
+            /**
+             * Multiplies by 2^n for an integral n, split in two factors so that any n in [-252, 254] is representable.
+             * A NaN n, for which the cast to an integer is undefined, is taken as 0.
+             */
+            inline float scale_pow2(float y, float n) {
+                int32_t k = n == n ? (int32_t) n : 0;
+                int32_t n1 = k / 2;
+                int32_t n2 = k - n1;
+                // The biased exponents are shifted as unsigned values
+                float scale1 = bits_float(int32_t(uint32_t(n1 + 127) << 23));
+                float scale2 = bits_float(int32_t(uint32_t(n2 + 127) << 23));
+                return y * scale1 * scale2;
+            }
+
+            /**
+             * Splits x = 2^e * (1 + f), with 1 + f in [sqrt(0.5), sqrt(2)).
+             * Valid only for positive normal numbers.
+             */
+            inline float log_reduce(float x, int32_t &e) {
+                int32_t bits = float_bits(x);
+                float m = bits_float((bits & 0x007fffff) | 0x3f800000);
+                e = ((bits >> 23) & 0xff) - 127;
+                bool big = m > 1.41421356f;
+                e = big ? e + 1 : e;
+                m = big ? m * 0.5f : m;
+                return m - 1.0f;
+            }
+
+#pragma omp declare simd notinbranch
+            inline float exp(float x) {
+                // Beyond these e^x overflows or underflows to zero
+                float const max_x = 88.7228394f;
+                float const min_x = -103.972084f;
+                float xc = x > max_x ? max_x : (x < min_x ? min_x : x);
+                // Cody-Waite reduction e^x = 2^n * e^r with |r| <= ln(2) / 2
+                float n = round_nearest(xc * 1.44269504f);
+                float r = xc - n * 0.693359375f;
+                r = r + n * 2.12194440e-4f;
+                float p = 1.9875691500e-4f;
+                p = p * r + 1.3981999507e-3f;
+                p = p * r + 8.3334519073e-3f;
+                p = p * r + 4.1665795894e-2f;
+                p = p * r + 1.6666665459e-1f;
+                p = p * r + 5.0000001201e-1f;
+                float y = p * r * r + r + 1.0f;
+                y = scale_pow2(y, n);
+                y = x > max_x ? INF : y;
+                return x < min_x ? 0.0f : y;
+            }
+
+#pragma omp declare simd notinbranch
+            inline float log(float x) {
+                // Denormals are normalized first
+                bool denormal = x < std::numeric_limits<float>::min();
+                int32_t e;
+                float f = log_reduce(denormal ? x * 8388608.0f : x, e);
+                e = denormal ? e - 23 : e;
+                // log(1 + f) = f - f^2 / 2 + s * (f^2 / 2 + R(s^2)), where s = f / (2 + f)
+                float s = f / (2.0f + f);
+                float z = s * s;
+                float w = z * z;
+                float t1 = w * (0.40000972152f + w * 0.24279078841f);
+                float t2 = z * (0.66666662693f + w * 0.28498786688f);
+                float hfsq = 0.5f * f * f;
+                float k = (float) e;
+                float y = k * 6.9313812256e-01f - ((hfsq - (s * (hfsq + t1 + t2) + k * 9.0580006145e-06f)) - f);
+                y = x == INF ? INF : y;
+                y = x == 0.0f ? -INF : y;
+                return x < 0.0f or x != x ? NOT_A_NUMBER : y;
+            }
+
+#pragma omp declare simd notinbranch
+            inline float log1p(float x) {
+                float u = 1.0f + x;
+                // Corrects for the rounding error of 1 + x
+                float correction = ((u - 1.0f) - x) / u;
+                correction = u == 0.0f or u == INF ? 0.0f : correction;
+                float y = log(u) - correction;
+                return u == 1.0f ? x : y;
+            }
+
+#pragma omp declare simd notinbranch
+            inline float tanh(float x) {
+                float a = x < 0.0f ? -x : x;
+                // Polynomial for small arguments
+                float z = x * x;
+                float p = -5.70498872745e-3f;
+                p = p * z + 2.06390887954e-2f;
+                p = p * z - 5.37397155531e-2f;
+                p = p * z + 1.33314422036e-1f;
+                p = p * z - 3.33332819422e-1f;
+                float small = p * z * x + x;
+                // 1 - 2 / (e^2|x| + 1) for the rest
+                float large = 1.0f - 2.0f / (exp(2.0f * a) + 1.0f);
+                large = x < 0.0f ? -large : large;
+                return a < 0.625f ? small : large;
+            }
+
+            namespace fast {
+#pragma omp declare simd notinbranch
+                inline float exp(float x) {
+                    float xc = x > 88.7228394f ? 88.7228394f : (x < -103.972084f ? -103.972084f : x);
+                    float n = round_nearest(xc * 1.44269504f);
+                    float r = xc - n * 0.693147181f;
+                    float p = 8.33333333e-3f;
+                    p = p * r + 4.16666667e-2f;
+                    p = p * r + 1.66666667e-1f;
+                    p = p * r + 0.5f;
+                    float y = p * r * r + r + 1.0f;
+                    return scale_pow2(y, n);
+                }
+
+#pragma omp declare simd notinbranch
+                inline float log(float x) {
+                    int32_t e;
+                    float f = log_reduce(x, e);
+                    float s = f / (2.0f + f);
+                    float z = s * s;
+                    float y = (float) e * 0.693147181f + 2.0f * s + s * z * (0.666666667f + z * 0.4f);
+                    y = x == 0.0f ? -INF : y;
+                    return x < 0.0f or x != x ? NOT_A_NUMBER : y;
+                }
+
+#pragma omp declare simd notinbranch
+                inline float log1p(float x) {
+                    float u = 1.0f + x;
+                    float y = log(u) - ((u - 1.0f) - x) / u;
+                    return u == 1.0f ? x : y;
+                }
+
+#pragma omp declare simd notinbranch
+                inline float tanh(float x) {
+                    float a = x < 0.0f ? -x : x;
+                    float z = x * x;
+                    float small = ((5.37397155531e-2f * z - 1.33314422036e-1f) * z + 3.33332819422e-1f) * -z * x + x;
+                    float large = 1.0f - 2.0f / (exp(2.0f * a) + 1.0f);
+                    large = x < 0.0f ? -large : large;
+                    return a < 0.3f ? small : large;
+                }
+            }
+        }
+    }
+}
+#endif //METADIFF_KERNELS_VMATH_H
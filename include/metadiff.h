@@ -10,14 +10,27 @@
 #include "iostream"
 #include "iomanip"
 #include <exception>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
 #include <fstream>
 #include <dlfcn.h>
+#include <unistd.h>
 #include "sstream"
 
 #include "os.h"
 #include "logging.h"
+#include "trace.h"
 #include "symbolic.h"
 #include "defs.h"
+#include "kernels.h"
 #include "shared.h"
 #include "core.h"
 #include "exceptions.h"
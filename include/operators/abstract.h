@@ -281,6 +281,10 @@ namespace metadiff {
                 return NodeVec {};
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 auto err = WrongGradient(NodeVec{owner, my_grad}, name);
                 logger()->error() << err.msg;
@@ -338,6 +342,10 @@ namespace metadiff {
                     }
                 }
             };
+
+            OperatorCost cost() const {
+                return elementwise_cost(parents.size() - 1);
+            }
         };
 
         /** Abstract class for unary logical operators */
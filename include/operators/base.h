@@ -51,6 +51,10 @@ namespace metadiff {
                 return std::make_shared<Alias>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return OperatorCost();
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return my_grad;
             }
@@ -86,6 +90,14 @@ namespace metadiff {
                 return std::make_shared<Broadcast>(graph, ancestors[0], to_shape);
             }
 
+            /**
+             * No arithmetic, while the full broadcasted result is counted as written, as if it were materialized.
+             * The backends inline it into its children, thus this is an upper bound of its traffic.
+             */
+            OperatorCost cost() const {
+                return elementwise_cost(0);
+            }
+
             Shape get_shape() const {
                 return to_shape;
             }
@@ -146,6 +158,12 @@ namespace metadiff {
                 return std::make_shared<Sum>(graph, ancestors[0], axes);
             }
 
+            OperatorCost cost() const {
+                OperatorCost result = elementwise_cost(0);
+                result.flops = number_of_elements(parent->shape);
+                return result;
+            }
+
             Shape get_shape() const {
                 Shape p_shape = parent->shape;
                 for (int i = 0; i < axes.size(); i++) {
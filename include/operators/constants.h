@@ -55,6 +55,33 @@ namespace metadiff{
             }
         };
 
+        /**
+         * Scalar which is a constant for the graph, but its value is kept in a table of the compiled function,
+         * indexed by the slot, and can be changed between calls without recompiling, e.g. a learning rate
+         */
+        class Hyperparameter : public ConstantOperator {
+        public:
+            size_t slot;
+            double value;
+
+            Hyperparameter(GraphInPtr graph, size_t slot, double value, dType dtype) :
+                    ConstantOperator("Hyperparameter", graph, scalar_shape, dtype),
+                    slot(slot),
+                    value(value) { };
+
+            std::shared_ptr<Operator> copy_to(GraphInPtr graph, NodeVec ancestors) const {
+                return std::make_shared<Hyperparameter>(graph, slot, value, dtype);
+            }
+
+            bool equals(std::shared_ptr<const Operator> const op) const {
+                if (name == op->name) {
+                    auto cast_op = std::static_pointer_cast<const Hyperparameter>(op);
+                    return slot == cast_op->slot;
+                }
+                return false;
+            }
+        };
+
         /** Matrix identity */
         class Eye : public ConstantOperator {
         public:
@@ -103,6 +130,10 @@ namespace metadiff{
                 return std::make_shared<MakeConstant>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return OperatorCost();
+            }
+
             nodeType get_node_type() const {
                 return CONSTANT_DERIVED;
             };
@@ -208,6 +239,18 @@ namespace metadiff{
             return derived_node(op);
         }
 
+        Node GraphInternal::hyperparameter(double value, std::string name) {
+            size_t slot = 0;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                if (nodes[i]->op->name == "Hyperparameter") {
+                    slot++;
+                }
+            }
+            Node result = derived_node(std::make_shared<op::Hyperparameter>(this, slot, value, max_float));
+            result->name = name;
+            return result;
+        }
+
         Node GraphInternal::zeros(Shape shape, dType type) {
             return derived_node(std::make_shared<op::ConstantValue>(this, 0.0, shape, type));
         }
@@ -36,6 +36,10 @@ namespace metadiff {
                 return std::make_shared<Exp>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, owner});
             }
@@ -51,6 +55,10 @@ namespace metadiff {
                 return std::make_shared<Log>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.div()});
             }
@@ -66,6 +74,10 @@ namespace metadiff {
                 return std::make_shared<Log>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(1, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.div(), graph->LN_10().div()});
             }
@@ -99,6 +111,10 @@ namespace metadiff {
                 return std::make_shared<Log1p>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.sigmoid()});
             }
@@ -114,6 +130,10 @@ namespace metadiff {
                 return std::make_shared<Sin>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.cos()});
             }
@@ -129,6 +149,10 @@ namespace metadiff {
                 return std::make_shared<Cos>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.sin().neg()});
             }
@@ -144,6 +168,10 @@ namespace metadiff {
                 return std::make_shared<Tan>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.cos().square().div()});
             }
@@ -159,6 +187,10 @@ namespace metadiff {
                 return std::make_shared<Cot>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.sin().square().div()}).neg();
             }
@@ -174,6 +206,10 @@ namespace metadiff {
                 return std::make_shared<Sinh>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.cosh()});
             }
@@ -189,6 +225,10 @@ namespace metadiff {
                 return std::make_shared<Cosh>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 return Node::mul(NodeVec{my_grad, parent.sinh()});
             }
@@ -204,6 +244,10 @@ namespace metadiff {
                 return std::make_shared<Tanh>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 Node derivative = Node::add(NodeVec{graph->constant_value(1.0), owner.square().neg()});
                 return Node::mul(NodeVec{my_grad, derivative});
@@ -220,6 +264,10 @@ namespace metadiff {
                 return std::make_shared<Coth>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 Node derivative = graph->constant_value(1.0).add(NodeVec{owner.square().neg()});
                 return Node::mul(NodeVec{my_grad, derivative});
@@ -236,6 +284,10 @@ namespace metadiff {
                 return std::make_shared<Pow>(graph, ancestors[0], ancestors[1]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0, 1);
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 Node product = Node::mul(NodeVec{my_grad, owner});
                 if (index == 0) {
@@ -23,6 +23,11 @@ namespace metadiff {
                 return std::make_shared<Input>(graph, dtype);
             }
 
+            /** Inputs are provided, so they cost nothing */
+            OperatorCost cost() const {
+                return OperatorCost();
+            }
+
             dType get_dtype() const {
                 return dtype;
             }
@@ -71,6 +76,11 @@ namespace metadiff {
                 return std::make_shared<SharedInput>(graph, var);
             }
 
+            /** Shared variables are already in memory, so they cost nothing */
+            OperatorCost cost() const {
+                return OperatorCost();
+            }
+
             dType get_dtype() const {
                 return var->get_dtype();
             }
@@ -196,6 +206,14 @@ namespace metadiff {
             return node;
         }
 
+        Node GraphInternal::shared_variable(kernels::HostArray value, std::string name) {
+            SharedPtr shared = shared::make_shared(value, name);
+            std::shared_ptr<Operator> op = std::make_shared<op::SharedInput>(this, shared);
+            Node node = derived_node(op);
+            node->name = name;
+            return node;
+        };
+
 #ifdef AFAPI
         Node GraphInternal::shared_variable(af::array value, std::string name) {
             SharedPtr shared = shared::make_shared(value, name);
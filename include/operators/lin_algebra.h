@@ -20,6 +20,10 @@ namespace metadiff{
                 return std::make_shared<Transpose>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0);
+            }
+
             Shape get_shape() const {
                 Shape shape{SymInt::one, SymInt::one, SymInt::one, SymInt::one};
                 int last_non_zero = 0;
@@ -84,6 +88,17 @@ namespace metadiff{
                 return std::make_shared<MatrixMultiplication>(graph, ancestors);
             }
 
+            OperatorCost cost() const {
+                // The product is evaluated left to right, each step taking 2 * m * k * n flops
+                OperatorCost result = elementwise_cost(0);
+                SymInt inner = parents[0]->shape[1];
+                for (size_t i = 1; i < parents.size(); i++) {
+                    result.flops = result.flops + 2 * parents[0]->shape[0] * inner * parents[i]->shape[1];
+                    inner = parents[i]->shape[1];
+                }
+                return result;
+            }
+
             MatrixMultiplication(GraphInPtr graph,
                                  Node parent1,
                                  Node parent2) :
@@ -156,6 +171,12 @@ namespace metadiff{
                 return std::make_shared<MatrixInverse>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                OperatorCost result = elementwise_cost(0);
+                result.flops = 2 * parent->shape[0] * parent->shape[0] * parent->shape[0];
+                return result;
+            }
+
             Node get_parent_grad(Node my_grad, unsigned short index) {
                 Node this_tr = owner.transpose();
                 return Node::dot(NodeVec{this_tr, my_grad, this_tr}).neg();
@@ -183,6 +204,12 @@ namespace metadiff{
                 return std::make_shared<Determinant>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                OperatorCost result = elementwise_cost(0);
+                result.flops = parent->shape[0] * parent->shape[0] * parent->shape[0];
+                return result;
+            }
+
             Shape get_shape() const {
                 return scalar_shape;
             }
@@ -214,6 +241,13 @@ namespace metadiff{
                 return std::make_shared<LogDeterminant>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                OperatorCost result = elementwise_cost(0);
+                result.flops = parent->shape[0] * parent->shape[0] * parent->shape[0];
+                result.transcendentals = parent->shape[0];
+                return result;
+            }
+
             dType get_dtype() const {
                 return graph->max_float;
             }
@@ -249,6 +283,12 @@ namespace metadiff{
                 return std::make_shared<Trace>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                OperatorCost result = elementwise_cost(0);
+                result.flops = parent->shape[0];
+                return result;
+            }
+
 
 
             Shape get_shape() const {
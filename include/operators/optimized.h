@@ -33,6 +33,11 @@ namespace metadiff {
                                                                  ancestors[2], ancestors[3]);
             }
 
+            /** The softplus terms are arguments, so only p * (sf(-x) - sf(x)) + sf(x) is computed */
+            OperatorCost cost() const {
+                return elementwise_cost(3);
+            }
+
             dType get_dtype() const{
                 return graph->max_float;
             }
@@ -39,6 +39,10 @@ namespace metadiff{
                 return std::make_shared<Diagonal>(graph, ancestors[0]);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0);
+            }
+
             Shape get_shape() const {
                 return shape;
             }
@@ -68,6 +72,11 @@ namespace metadiff{
                 return std::make_shared<Reshape>(graph, ancestors[0], shape);
             }
 
+            /** Reshapes only change the dimensions, without moving any data */
+            OperatorCost cost() const {
+                return OperatorCost();
+            }
+
             Shape get_shape() const {
                 return shape;
             }
@@ -118,12 +127,9 @@ namespace metadiff{
                     logger()->error() << err.msg;
                     throw err;
                 }
-                std::vector<bool> checks;
-                for(int i=0; i<order.size(); i++){
-                    checks.push_back(false);
-                }
+                std::vector<bool> checks(4, false);
                 for (int i = 0; i < order.size(); i++) {
-                    if (0 > order[i] or order[i] > 4) {
+                    if (0 > order[i] or order[i] > 3) {
                         auto err = InvalidArguments(NodeVec{this->parent}, name, "The ordering must contain elements in the range [0,3]");
                         logger()->error() << err.msg;
                         throw err;
@@ -133,7 +139,7 @@ namespace metadiff{
                         logger()->error() << err.msg;
                         throw err;
                     }
-                    checks[i] = true;
+                    checks[order[i]] = true;
                 }
             };
 
@@ -141,6 +147,10 @@ namespace metadiff{
                 return std::make_shared<Reorder>(graph, ancestors[0], order);
             }
 
+            OperatorCost cost() const {
+                return elementwise_cost(0);
+            }
+
             Shape get_shape() const {
                 Shape shape = scalar_shape;
                 for(int i=0; i<4; i++){
@@ -7,6 +7,12 @@
 
 #include "curl/curl.h"
 #include <sys/stat.h>
+#include <dirent.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
 #include "fstream"
 
 namespace metadiff{
@@ -49,10 +55,15 @@ namespace metadiff{
             }
         }
 
-        /** Function to create a temporary directory and return its path
+        /** Function to create a temporary directory and return its path,
+         * throws std::runtime_error when it can not be created
          * TODO - make this cross-platform */
         std::string make_temp_dir() {
-            std::string path = std::tmpnam(nullptr);
+            char path[] = "/tmp/metadiff_XXXXXX";
+            if (mkdtemp(path) == nullptr) {
+                throw std::runtime_error("Error creating a temporary directory from " + std::string(path) +
+                                         ": " + std::strerror(errno));
+            }
             return path;
         };
 
@@ -141,6 +152,44 @@ namespace metadiff{
             return ((long long)st.st_size);
         }
 
+        /** Reads the whole file into a string, which is empty if the file does not exist */
+        std::string read_file(std::string path){
+            std::ifstream file(path);
+            return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        }
+
+        /** Returns the paths of all regular files in the directory
+         * TODO - make this cross-platform */
+        std::vector<std::string> list_files(std::string path){
+            std::vector<std::string> files;
+            DIR *dir = opendir(path.c_str());
+            if(dir == nullptr){
+                return files;
+            }
+            while(struct dirent *entry = readdir(dir)){
+                std::string file = join_paths(path, entry->d_name);
+                if(entry->d_name[0] != '.' and not is_dir(file)){
+                    files.push_back(file);
+                }
+            }
+            closedir(dir);
+            std::sort(files.begin(), files.end());
+            return files;
+        }
+
+        /** Directory for files cached between runs, given by METADIFF_CACHE or ~/.cache/metadiff otherwise */
+        std::string cache_dir(){
+            if(getenv("METADIFF_CACHE")){
+                create_dir(getenv("METADIFF_CACHE"), true);
+                return getenv("METADIFF_CACHE");
+            }
+            std::string path = join_paths(getenv("HOME") ? getenv("HOME") : "/tmp", ".cache");
+            create_dir(path, true);
+            path = join_paths(path, "metadiff");
+            create_dir(path, true);
+            return path;
+        }
+
         /** Definitely not cross platform, but for now will do */
         int unpack_gz(std::string gz_path){
             return system(("gzip -d -f " + gz_path).c_str());
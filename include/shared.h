@@ -27,6 +27,29 @@ namespace metadiff{
         typedef std::shared_ptr<SharedVariable> SharedPtr;
         static std::vector<SharedPtr> shared_vars;
 
+        /** A shared variable stored in host memory, used by the CpuBackend */
+        class HostVariable: public SharedVariable {
+        public:
+            kernels::HostArray value;
+            HostVariable(size_t id,
+                         kernels::HostArray value,
+                         std::string name):
+                    SharedVariable(id, value.dims, name),
+                    value(value) {};
+
+            core::dType get_dtype() const{
+                return core::f32;
+            }
+        };
+
+        typedef std::shared_ptr<HostVariable> HostShared;
+
+        static SharedPtr make_shared(kernels::HostArray value, std::string name){
+            SharedPtr ptr = std::make_shared<HostVariable>(shared_vars.size(), value, name);
+            shared_vars.push_back(ptr);
+            return ptr;
+        }
+
 #ifdef AFAPI
 
         /** A shared variable is a like a static variable, which is synchronized between devices */
@@ -5,6 +5,8 @@
 #ifndef METADIFF_SYMBOLIC_H
 #define METADIFF_SYMBOLIC_H
 
+#include <algorithm>
+#include <limits>
 
 namespace metadiff {
     namespace symbolic {
@@ -28,6 +30,121 @@ namespace metadiff {
         };
 
 
+        /**
+         * A vector which keeps up to N elements inline and moves them to the heap only when it grows beyond that.
+         * Shapes are built from very short polynomials, so this avoids allocating on every copy of them.
+         */
+        template<typename T, size_t N>
+        class SmallVector {
+        private:
+            T buffer[N];
+            /** Holds all of the elements once there are more than N, otherwise it is empty */
+            std::vector<T> heap;
+            size_t count;
+        public:
+            typedef T value_type;
+            typedef T *iterator;
+            typedef T const *const_iterator;
+            typedef T &reference;
+            typedef T const &const_reference;
+            typedef size_t size_type;
+
+            SmallVector(): count(0) {};
+
+            bool on_heap() const {
+                return not heap.empty();
+            }
+
+            T *data() {
+                return on_heap() ? heap.data() : buffer;
+            }
+
+            T const *data() const {
+                return on_heap() ? heap.data() : buffer;
+            }
+
+            size_t size() const {
+                return count;
+            }
+
+            bool empty() const {
+                return count == 0;
+            }
+
+            iterator begin() {
+                return data();
+            }
+
+            iterator end() {
+                return data() + count;
+            }
+
+            const_iterator begin() const {
+                return data();
+            }
+
+            const_iterator end() const {
+                return data() + count;
+            }
+
+            T &operator[](size_t i) {
+                return data()[i];
+            }
+
+            T const &operator[](size_t i) const {
+                return data()[i];
+            }
+
+            T &back() {
+                return data()[count - 1];
+            }
+
+            T const &back() const {
+                return data()[count - 1];
+            }
+
+            void push_back(T const &value) {
+                if (on_heap()) {
+                    heap.push_back(value);
+                } else if (count < N) {
+                    buffer[count] = value;
+                } else {
+                    heap.reserve(2 * N);
+                    heap.assign(buffer, buffer + N);
+                    heap.push_back(value);
+                }
+                count++;
+            }
+
+            void pop_back() {
+                if (on_heap()) {
+                    heap.pop_back();
+                }
+                count--;
+            }
+
+            iterator erase(iterator position) {
+                std::move(position + 1, end(), position);
+                pop_back();
+                return position;
+            }
+
+            void clear() {
+                heap.clear();
+                count = 0;
+            }
+        };
+
+        template<typename T, size_t N>
+        bool operator==(const SmallVector<T, N> &lhs, const SmallVector<T, N> &rhs) {
+            return lhs.size() == rhs.size() and std::equal(lhs.begin(), lhs.end(), rhs.begin());
+        }
+
+        template<typename T, size_t N>
+        bool operator!=(const SmallVector<T, N> &lhs, const SmallVector<T, N> &rhs) {
+            return not (lhs == rhs);
+        }
+
         template<typename I, typename P>
         class SymbolicMonomial {
             static_assert(std::numeric_limits<I>::is_integer, "I can be only instantiated with integer types");
@@ -35,9 +152,8 @@ namespace metadiff {
             static_assert(std::numeric_limits<P>::is_integer, "P can be only instantiated with unsigned types");
             static_assert(not std::numeric_limits<P>::is_signed, "P can be only instantiated with unsigned types");
         public:
-//            std::array<T, N> powers;
             /** A power first argument is the id of the variable, the second is the actual power */
-            std::vector<std::pair<I,P>> powers;
+            SmallVector<std::pair<I,P>, 2> powers;
             /** The constant coefficient */
             long long int coefficient;
 
@@ -65,12 +181,14 @@ namespace metadiff {
             }
 
             template <typename T>
-            long long int eval(std::vector<T> &values) {
-                T value = 0;
+            T eval(std::vector<T> const &values) const {
+                T value = this->coefficient;
                 for (auto i = 0; i < powers.size(); i++) {
-                    value += pow(values[powers[i].first], powers[i].second);
+                    for (P j = 0; j < powers[i].second; j++) {
+                        value *= values[powers[i].first];
+                    }
                 }
-                return value * this->coefficient;
+                return value;
             }
 
             long long int eval() {
@@ -397,24 +515,40 @@ namespace metadiff {
 
         template<typename I, typename P>
         class SymbolicPolynomial {
+        private:
+            /** Hash of the canonical form, which lets most inequalities be decided without touching the monomials */
+            size_t hash_value;
         public:
-            /** The monomials vector should be kept sorted according to less_then_comparator at all times */
-            std::vector<SymbolicMonomial<I, P>> monomials;
+            /**
+             * The monomials vector should be kept sorted according to less_then_comparator at all times.
+             * Any code which edits it directly has to call canonicalize() afterwards.
+             */
+            SmallVector<SymbolicMonomial<I, P>, 2> monomials;
 
-            SymbolicPolynomial() {};
+            SymbolicPolynomial() {
+                rehash();
+            };
 
             SymbolicPolynomial(const SymbolicPolynomial<I, P> &polynomial):
+                    hash_value(polynomial.hash_value),
                     monomials(polynomial.monomials){};
 
-            SymbolicPolynomial(const SymbolicMonomial<I, P> &monomial):
-                    monomials({monomial}) {};
+            SymbolicPolynomial(const SymbolicMonomial<I, P> &monomial) {
+                if (monomial.coefficient != 0) {
+                    monomials.push_back(monomial);
+                }
+                rehash();
+            };
 
             SymbolicPolynomial(const long long int value) {
                 if (value != 0) {
                     monomials.push_back(SymbolicMonomial<I, P>(value));
                 }
+                rehash();
             }
 
+            SymbolicPolynomial<I, P> &operator=(const SymbolicPolynomial<I, P> &polynomial) = default;
+
             static SymbolicPolynomial variable(const I variable) {
                 return SymbolicPolynomial(SymbolicMonomial<I, P>::variable(variable));
             }
@@ -433,27 +567,57 @@ namespace metadiff {
                 }
             }
 
-//            void simplify() {
-//                std::sort(this->monomials.begin(), this->monomials.end(), less_than_comparator<I, P>);
-//                for (int i = 1; i < this->monomials.size(); i++) {
-//                    if (up_to_coefficient(this->monomials[i - 1], this->monomials[i])) {
-//                        this->monomials[i - 1].coefficient += this->monomials[i].coefficient;
-//                        this->monomials.erase(this->monomials.begin() + i);
-//                        i--;
-//                    }
-//                }
-//                for (int i = 0; i < this->monomials.size(); i++) {
-//                    if (this->monomials[i].coefficient == 0) {
-//                        this->monomials.erase(this->monomials.begin() + i);
-//                        i--;
-//                    }
-//                }
-//            }
+            /** The value of a constant polynomial, without any checks */
+            long long int constant_value() const {
+                return monomials.size() == 0 ? 0 : monomials[0].coefficient;
+            }
+
+            size_t hash() const {
+                return hash_value;
+            }
+
+            /** Recomputes the hash, assuming the monomials are already in canonical order */
+            void rehash() {
+                size_t result = monomials.size();
+                for (size_t i = 0; i < monomials.size(); i++) {
+                    result = result * 1000003 + std::hash<long long int>()(monomials[i].coefficient);
+                    for (size_t j = 0; j < monomials[i].powers.size(); j++) {
+                        result = result * 31 + monomials[i].powers[j].first;
+                        result = result * 31 + monomials[i].powers[j].second;
+                    }
+                }
+                hash_value = result;
+            }
+
+            /** Sorts the monomials, merges those which differ only by coefficient and drops the zero ones */
+            void canonicalize() {
+                std::sort(monomials.begin(), monomials.end(), less_than_comparator<I, P>);
+                size_t last = 0;
+                for (size_t i = 0; i < monomials.size(); i++) {
+                    if (last > 0 and up_to_coefficient(monomials[last - 1], monomials[i])) {
+                        monomials[last - 1].coefficient += monomials[i].coefficient;
+                    } else {
+                        if (last > 0 and monomials[last - 1].coefficient == 0) {
+                            last--;
+                        }
+                        monomials[last] = monomials[i];
+                        last++;
+                    }
+                }
+                if (last > 0 and monomials[last - 1].coefficient == 0) {
+                    last--;
+                }
+                while (monomials.size() > last) {
+                    monomials.pop_back();
+                }
+                rehash();
+            }
+
             template <typename T>
-            T eval(std::vector<T> &values) {
+            T eval(std::vector<T> const &values) const {
                 T value = 0;
                 for(auto i = 0; i < monomials.size(); i++){
-                    value += monomials[i].eval<T>(values);
+                    value += monomials[i].template eval<T>(values);
                 }
                 return value;
             }
@@ -514,7 +678,7 @@ namespace metadiff {
 
         template<typename I, typename P>
         bool operator==(const SymbolicPolynomial<I, P> &lhs, const SymbolicPolynomial<I, P> &rhs) {
-            if (lhs.monomials.size() != rhs.monomials.size()) {
+            if (lhs.hash() != rhs.hash() or lhs.monomials.size() != rhs.monomials.size()) {
                 return false;
             }
             for (auto i = 0; i < lhs.monomials.size(); i++) {
@@ -581,6 +745,7 @@ namespace metadiff {
             for (auto i = 0; i < rhs.monomials.size(); i++) {
                 result.monomials[i].coefficient = -result.monomials[i].coefficient;
             }
+            result.rehash();
             return result;
         }
 
@@ -599,6 +764,7 @@ namespace metadiff {
                 result.monomials.push_back(rhs);
                 result.monomials.push_back(lhs);
             }
+            result.rehash();
             return result;
         }
 
@@ -612,8 +778,11 @@ namespace metadiff {
                 }
             } else {
                 result.monomials.push_back(lhs);
-                result.monomials.push_back(SymbolicMonomial<I,P>(rhs));
+                if (rhs != 0) {
+                    result.monomials.push_back(SymbolicMonomial<I,P>(rhs));
+                }
             }
+            result.rehash();
             return result;
         }
 
@@ -624,6 +793,9 @@ namespace metadiff {
 
         template<typename I, typename P>
         SymbolicPolynomial<I, P> operator+(const SymbolicPolynomial<I, P> &lhs, const SymbolicPolynomial<I, P> &rhs) {
+            if (lhs.is_constant() and rhs.is_constant()) {
+                return SymbolicPolynomial<I, P>(lhs.constant_value() + rhs.constant_value());
+            }
             auto result = SymbolicPolynomial<I, P>();
             auto i1 = 0;
             auto i2 = 0;
@@ -651,6 +823,7 @@ namespace metadiff {
                 result.monomials.push_back(rhs.monomials[i2]);
                 i2++;
             }
+            result.rehash();
             return result;
         }
 
@@ -720,11 +893,15 @@ namespace metadiff {
             for (auto i = 0; i < lhs.monomials.size(); i++) {
                 result.monomials.push_back(lhs.monomials[i] * rhs);
             }
+            result.canonicalize();
             return result;
         }
 
         template<typename I, typename P>
         SymbolicPolynomial<I, P> operator*(const SymbolicPolynomial<I, P> &lhs, const SymbolicPolynomial<I, P> &rhs) {
+            if (lhs.is_constant() and rhs.is_constant()) {
+                return SymbolicPolynomial<I, P>(lhs.constant_value() * rhs.constant_value());
+            }
             auto result = SymbolicPolynomial<I, P>();
             auto partial = SymbolicPolynomial<I, P>();
             for (int i = 0; i < lhs.monomials.size(); i++) {
@@ -732,6 +909,7 @@ namespace metadiff {
                 for (int j = 0; j < rhs.monomials.size(); j++) {
                     partial.monomials.push_back(lhs.monomials[i] * rhs.monomials[j]);
                 }
+                partial.canonicalize();
                 result = result + partial;
             }
             return result;
@@ -748,6 +926,7 @@ namespace metadiff {
             for (int i = 0; i < lhs.monomials.size(); i++) {
                 result.monomials.push_back(lhs.monomials[i] * rhs);
             }
+            result.canonicalize();
             return result;
         }
 
@@ -779,6 +958,7 @@ namespace metadiff {
             for (auto i = 0; i < lhs.monomials.size(); i++) {
                 result.monomials.push_back(lhs.monomials[i] / rhs);
             }
+            result.canonicalize();
             return result;
         }
 
@@ -789,6 +969,7 @@ namespace metadiff {
             }
             auto result = SymbolicPolynomial<I, P>();
             result.monomials.push_back(lhs / rhs.monomials[0]);
+            result.canonicalize();
             return result;
         }
 
@@ -801,6 +982,7 @@ namespace metadiff {
             for (auto i = 0; i < lhs.monomials.size(); i++) {
                 result.monomials.push_back(lhs.monomials[i] / rhs);
             }
+            result.canonicalize();
             return result;
         }
 
@@ -811,8 +993,114 @@ namespace metadiff {
             }
             auto result = SymbolicPolynomial<I, P>();
             result.monomials.push_back(lhs / rhs.monomials[0]);
+            result.canonicalize();
+            return result;
+        }
+
+        /** Adds two integers, saturating to the limits of long long instead of overflowing */
+        inline long long int saturating_add(long long int a, long long int b) {
+            long long int result;
+            if (__builtin_add_overflow(a, b, &result)) {
+                return b > 0 ? std::numeric_limits<long long int>::max() : std::numeric_limits<long long int>::min();
+            }
+            return result;
+        }
+
+        /** Multiplies two integers, saturating to the limits of long long instead of overflowing */
+        inline long long int saturating_mul(long long int a, long long int b) {
+            long long int result;
+            if (__builtin_mul_overflow(a, b, &result)) {
+                return (a < 0) == (b < 0) ? std::numeric_limits<long long int>::max() :
+                       std::numeric_limits<long long int>::min();
+            }
+            return result;
+        }
+
+        /**
+         * The values a symbolic integer can take, together with the one it most likely has.
+         * A symbolic integer without an annotation is anything from 1 up, most likely 1.
+         */
+        class SymbolicRange {
+        public:
+            long long int min;
+            long long int max;
+            long long int likely;
+
+            SymbolicRange():
+                    min(1), max(std::numeric_limits<long long int>::max()), likely(1) {};
+
+            SymbolicRange(long long int min, long long int max):
+                    min(min), max(max), likely(min) {};
+
+            SymbolicRange(long long int min, long long int max, long long int likely):
+                    min(min), max(max), likely(likely) {};
+
+            bool is_fixed() const {
+                return min == max;
+            }
+
+            bool contains(long long int value) const {
+                return min <= value and value <= max;
+            }
+        };
+
+        inline bool operator==(SymbolicRange const &lhs, SymbolicRange const &rhs) {
+            return lhs.min == rhs.min and lhs.max == rhs.max and lhs.likely == rhs.likely;
+        }
+
+        inline bool operator!=(SymbolicRange const &lhs, SymbolicRange const &rhs) {
+            return not (lhs == rhs);
+        }
+
+        inline std::ostream &operator<<(std::ostream &f, SymbolicRange const &range) {
+            f << "[" << range.min << ", " << range.max << "] ~" << range.likely;
+            return f;
+        }
+
+        inline SymbolicRange operator+(SymbolicRange const &lhs, SymbolicRange const &rhs) {
+            return SymbolicRange(saturating_add(lhs.min, rhs.min), saturating_add(lhs.max, rhs.max),
+                                 saturating_add(lhs.likely, rhs.likely));
+        }
+
+        inline SymbolicRange operator*(SymbolicRange const &lhs, SymbolicRange const &rhs) {
+            long long int products[4] = {saturating_mul(lhs.min, rhs.min), saturating_mul(lhs.min, rhs.max),
+                                         saturating_mul(lhs.max, rhs.min), saturating_mul(lhs.max, rhs.max)};
+            return SymbolicRange(*std::min_element(products, products + 4), *std::max_element(products, products + 4),
+                                 saturating_mul(lhs.likely, rhs.likely));
+        }
+
+        /** The range of the monomial, given the range of each variable by its id */
+        template<typename I, typename P>
+        SymbolicRange range(SymbolicMonomial<I, P> const &monomial, std::vector<SymbolicRange> const &ranges) {
+            SymbolicRange result(monomial.coefficient, monomial.coefficient);
+            for (size_t i = 0; i < monomial.powers.size(); i++) {
+                SymbolicRange variable = monomial.powers[i].first < ranges.size() ?
+                                         ranges[monomial.powers[i].first] : SymbolicRange();
+                for (P j = 0; j < monomial.powers[i].second; j++) {
+                    result = result * variable;
+                }
+            }
+            return result;
+        }
+
+        /** The range of the polynomial, given the range of each variable by its id */
+        template<typename I, typename P>
+        SymbolicRange range(SymbolicPolynomial<I, P> const &polynomial, std::vector<SymbolicRange> const &ranges) {
+            SymbolicRange result(0, 0);
+            for (size_t i = 0; i < polynomial.monomials.size(); i++) {
+                result = result + range(polynomial.monomials[i], ranges);
+            }
             return result;
         }
     }
 }
+
+namespace std {
+    template<typename I, typename P>
+    struct hash<metadiff::symbolic::SymbolicPolynomial<I, P>> {
+        size_t operator()(metadiff::symbolic::SymbolicPolynomial<I, P> const &polynomial) const {
+            return polynomial.hash();
+        }
+    };
+}
 #endif //METADIFF_SYMBOLIC_H
@@ -0,0 +1,220 @@
+//
+// Created by alex on 24/10/16.
+//
+
+#ifndef METADIFF_TRACE_H
+#define METADIFF_TRACE_H
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace metadiff {
+    namespace trace {
+        /** A completed span, with its times in microseconds since the collector was created */
+        class TraceEvent {
+        public:
+            std::string name;
+            std::string category;
+            double start;
+            double duration;
+            size_t thread;
+            std::vector<std::pair<std::string, std::string>> args;
+        };
+
+        /**
+         * The process wide collector of the spans, written in the Chrome trace event format, which is
+         * opened by chrome://tracing and Perfetto. When disabled, which is the default, a span only checks
+         * an atomic flag. Setting METADIFF_TRACE to a path enables it and writes the trace there at exit.
+         */
+        class TraceCollector {
+        public:
+            std::atomic<bool> enabled;
+            std::mutex mutex;
+            std::chrono::steady_clock::time_point origin;
+            std::vector<TraceEvent> events;
+            /** Small sequential ids of the threads, which are easier to read than their native ids */
+            std::map<std::thread::id, size_t> threads;
+            /** The path written when the process exits, empty for none */
+            std::string exit_path;
+
+            TraceCollector() :
+                    enabled(false),
+                    origin(std::chrono::steady_clock::now()) {
+                if (getenv("METADIFF_TRACE")) {
+                    exit_path = getenv("METADIFF_TRACE");
+                    enabled = true;
+                }
+            }
+
+            ~TraceCollector() {
+                if (exit_path != "") {
+                    write(exit_path);
+                }
+            }
+
+            /** Microseconds from the creation of the collector to the time point */
+            double microseconds(std::chrono::steady_clock::time_point time) const {
+                return std::chrono::duration<double, std::micro>(time - origin).count();
+            }
+
+            /** Records a span, which must have been started by the calling thread */
+            void record(TraceEvent event) {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto thread = threads.insert({std::this_thread::get_id(), threads.size()});
+                event.thread = thread.first->second;
+                events.push_back(event);
+            }
+
+            /** Writes all spans recorded so far as a JSON trace to the path, returns false if it fails */
+            bool write(std::string path) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::ofstream f(path);
+                f << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+                for (size_t i = 0; i < events.size(); i++) {
+                    f << "{\"name\": \"" << escape(events[i].name) << "\", \"cat\": \""
+                      << escape(events[i].category) << "\", \"ph\": \"X\", \"ts\": " << std::fixed
+                      << events[i].start << ", \"dur\": " << events[i].duration << ", \"pid\": " << getpid()
+                      << ", \"tid\": " << events[i].thread << ", \"args\": {";
+                    for (size_t j = 0; j < events[i].args.size(); j++) {
+                        f << (j > 0 ? ", " : "") << "\"" << escape(events[i].args[j].first) << "\": \""
+                          << escape(events[i].args[j].second) << "\"";
+                    }
+                    f << "}}" << (i + 1 < events.size() ? ",\n" : "\n");
+                }
+                f << "]}\n";
+                return f.good();
+            }
+
+            /** Escapes the string to be a JSON string */
+            static std::string escape(std::string value) {
+                std::stringstream result;
+                for (size_t i = 0; i < value.size(); i++) {
+                    char c = value[i];
+                    if (c == '"' or c == '\\') {
+                        result << '\\' << c;
+                    } else if (c == '\n') {
+                        result << "\\n";
+                    } else if (c == '\t') {
+                        result << "\\t";
+                    } else if ((unsigned char) c < 0x20) {
+                        result << ' ';
+                    } else {
+                        result << c;
+                    }
+                }
+                return result.str();
+            }
+        };
+
+        /** The collector of the process */
+        TraceCollector &collector() {
+            static TraceCollector instance;
+            return instance;
+        }
+
+        /** Whether the spans are being recorded */
+        bool enabled() {
+            return collector().enabled.load(std::memory_order_relaxed);
+        }
+
+        /** Starts recording spans */
+        void enable() {
+            collector().enabled = true;
+        }
+
+        /** Stops recording spans, the ones recorded so far are kept */
+        void disable() {
+            collector().enabled = false;
+        }
+
+        /** Discards all of the spans recorded so far */
+        void clear() {
+            std::lock_guard<std::mutex> lock(collector().mutex);
+            collector().events.clear();
+        }
+
+        /** Writes all of the spans recorded so far to the path, see TraceCollector::write */
+        bool write(std::string path) {
+            return collector().write(path);
+        }
+
+        /** Records a span from its start to its end, which were measured elsewhere */
+        void record(std::string name, std::string category,
+                    std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+                    std::vector<std::pair<std::string, std::string>> args = {}) {
+            if (not enabled()) {
+                return;
+            }
+            TraceEvent event;
+            event.name = name;
+            event.category = category;
+            event.start = collector().microseconds(start);
+            event.duration = std::chrono::duration<double, std::micro>(end - start).count();
+            event.args = args;
+            collector().record(event);
+        }
+
+        /**
+         * A span of a phase, recorded from its construction until its destruction or the call to finish.
+         * The name and the category are not copied, thus they should be literals.
+         * For example graph construction in user code can be traced by:
+         *   metadiff::trace::Span span("build model", "graph");
+         */
+        class Span {
+        private:
+            char const *name;
+            char const *category;
+            bool active;
+            std::chrono::steady_clock::time_point start;
+            std::vector<std::pair<std::string, std::string>> args;
+        public:
+            Span(char const *name, char const *category) :
+                    name(name),
+                    category(category),
+                    active(enabled()) {
+                if (active) {
+                    start = std::chrono::steady_clock::now();
+                }
+            }
+
+            Span(Span const &) = delete;
+
+            Span &operator=(Span const &) = delete;
+
+            ~Span() {
+                finish();
+            }
+
+            /** Whether the span is recorded, thus whether computing its arguments is needed */
+            bool is_active() const {
+                return active;
+            }
+
+            /** Adds an argument shown with the span */
+            void arg(std::string key, std::string value) {
+                if (active) {
+                    args.push_back({key, value});
+                }
+            }
+
+            /** Ends the span before its destruction */
+            void finish() {
+                if (active) {
+                    active = false;
+                    record(name, category, start, std::chrono::steady_clock::now(), args);
+                }
+            }
+        };
+    }
+}
+
+#endif //METADIFF_TRACE_H
@@ -9,6 +9,16 @@ namespace metadiff {
     namespace dagre {
         using namespace core;
 
+        /** The measurement of profile mode by which the nodes and the groups are colored */
+        enum heatMetric {
+            /** The nodes are colored by their type */
+                    NO_HEAT = 0,
+            /** The mean time to compute the node, summed over the nodes of a group */
+                    TIME_HEAT = 1,
+            /** The size in bytes of the value of the node, summed over the nodes of a group */
+                    BYTES_HEAT = 2
+        };
+
         /**
          * Writes the template part of the html at the top
          */
@@ -18,9 +28,17 @@ namespace metadiff {
          */
         void print_html_footers(std::ofstream& f, Graph& graph);
         /**
-         * Generates the javascript for the node
+         * Generates the javascript for the node, with the style overriding its default one if not empty
+         */
+        void print_node(std::ofstream& f, Node node, std::string style = "");
+        /**
+         * The measurement of the node for the metric, negative when it has not been measured
          */
-        void print_node(std::ofstream& f, Node node);
+        double heat_value(Node node, heatMetric heat);
+        /**
+         * The fill color for a fraction of the largest measurement, from white to red
+         */
+        std::string heat_color(double fraction);
         /**
          * Generates the javascript for all edges going in to the node
          */
@@ -34,13 +52,37 @@ namespace metadiff {
          */
         void print_update_edge(std::ofstream& f, Update update);
 
+        /**
+         * Writes the graph to an html file. With a heat metric other than NO_HEAT, the nodes and the groups
+         * are colored by their measurements from profile mode, relative to the largest node and group.
+         */
         void dagre_to_file(std::string file_path,
                            Graph graph,
-                           Updates& updates) {
+                           Updates& updates,
+                           heatMetric heat = NO_HEAT) {
             // Open file
             std::ofstream f;
             f.open(file_path);
 
+            // Sum the measurements of the nodes over each group and all of its parents
+            std::vector<double> node_heat(graph->nodes.size(), -1);
+            std::map<std::string, double> group_heat;
+            double max_node = 0, max_group = 0;
+            for(size_t i=0; heat != NO_HEAT and i < graph->nodes.size(); i++){
+                node_heat[i] = heat_value(graph->nodes[i], heat);
+                if(node_heat[i] > 0){
+                    max_node = std::max(max_node, node_heat[i]);
+                    std::shared_ptr<NodeGroup> group = graph->nodes[i]->group.lock();
+                    while(group){
+                        group_heat[group->full_name] += node_heat[i];
+                        group = group->parent.lock();
+                    }
+                }
+            }
+            for(size_t i=1; i < graph->groups.size(); i++){
+                max_group = std::max(max_group, group_heat[graph->groups[i]->full_name]);
+            }
+
             // Print headers
             print_html_headers(f, graph);
             f << "\t// Create a new graph morpher\n"
@@ -50,14 +92,25 @@ namespace metadiff {
             f << "\t// Set all groups\n";
             for(size_t i=1;i<graph->groups.size(); i++){
                 f << "\tmorpher.addGroup(\"_root/"
-                << graph->groups[i]->full_name
-                << "\");\n";
+                << graph->groups[i]->full_name;
+                if(max_group > 0){
+                    double value = group_heat[graph->groups[i]->full_name];
+                    f << "\", \"" << heat_color(value / max_group) << "\", \""
+                    << (heat == TIME_HEAT ? "Time: " : "Bytes: ")
+                    << (heat == TIME_HEAT ? value * 1e3 : value)
+                    << (heat == TIME_HEAT ? " ms" : "");
+                }
+                f << "\");\n";
             }
 
             // Print all nodes
             f << "\n\t// Add all nodes\n";
             for(size_t i=0; i < graph->nodes.size(); i++){
-                print_node(f, graph->nodes[i]);
+                if(max_node > 0 and node_heat[i] >= 0){
+                    print_node(f, graph->nodes[i], "fill: " + heat_color(node_heat[i] / max_node));
+                } else {
+                    print_node(f, graph->nodes[i]);
+                }
             }
 
             // Print graph updates
@@ -100,9 +153,25 @@ namespace metadiff {
             f.close();
         }
 
-        void dagre_to_file(std::string file_path, Graph graph){
+        void dagre_to_file(std::string file_path, Graph graph, heatMetric heat = NO_HEAT){
             Updates updates;
-            dagre_to_file(file_path, graph, updates);
+            dagre_to_file(file_path, graph, updates, heat);
+        }
+
+        double heat_value(Node node, heatMetric heat){
+            if(heat == TIME_HEAT){
+                return node->execution.time;
+            } else if(heat == BYTES_HEAT and node->execution.time >= 0){
+                return node->execution.bytes;
+            }
+            return -1;
+        }
+
+        std::string heat_color(double fraction){
+            int level = int(255 * (1 - std::min(std::max(fraction, 0.0), 1.0)));
+            std::stringstream color;
+            color << "#ff" << std::hex << std::setfill('0') << std::setw(2) << level << std::setw(2) << level;
+            return color.str();
         }
 
         /**
@@ -214,6 +283,10 @@ namespace metadiff {
             node->shape[3] << ") <br>\"+\n";
             f << "\t\t\t\"Device: " << node->device << " <br>\"+\n";
             f << "\t\t\t\"Gradient Level:" << node->grad_level << " <br>\"+\n";
+            if(node->execution.time >= 0){
+                f << "\t\t\t\"Time: " << node->execution.time * 1e3 << " ms <br>\"+\n";
+                f << "\t\t\t\"Bytes: " << node->execution.bytes << " <br>\"+\n";
+            }
             f << "\t\t\t\"Parents: ";
             print_ids(f , node->op->get_ancestors()) << " <br>\"+\n";
             f << "\t\t\t\"Children: ";
@@ -232,7 +305,7 @@ namespace metadiff {
             return false;
         }
 
-        void print_node(std::ofstream& f, Node node){
+        void print_node(std::ofstream& f, Node node, std::string style){
             // The javascript code is:
             // moprpher.addNode("<group>", "<node name>", "{<node attributes>}");
             if(is_constant(node)){
@@ -254,6 +327,9 @@ namespace metadiff {
                 print_name(f, node) << "\",\n";
                 f << "\t\tshape: \"";
                 print_shape(f, node) << "\",\n";
+                if(style != ""){
+                    f << "\t\tstyle: \"" << style << "\",\n";
+                }
                 // Print the description
                 print_description(f, node) << "});\n";
             }
@@ -323,6 +399,7 @@ namespace metadiff {
                     "<h5 style=\"margin-top: 0px; margin-bottom: 0px\">Default device: " << graph->default_device << "</h5>\n"
                     "<h5 style=\"margin-top: 0px; margin-bottom: 0px\">Max Float type: " << graph->max_float << "</h5>\n"
                     "<h5 style=\"margin-top: 0px; margin-bottom: 0px\">Max Int type: " << graph->max_int << "</h5>\n"
+                    "<h5 style=\"margin-top: 0px; margin-bottom: 0px\">Math precision: " << graph->precision << "</h5>\n"
                     "<h5 style=\"margin-top: 0px; margin-bottom: 0px\">Broadcast policy: " << graph->broadcast_err_policy << "</h5>\n\n"
                     "<h5 style=\"margin-top: 0px; margin-bottom: 0px\">Broadcast policy: " << graph->broadcast_err_policy << "</h5>\n\n"
                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                               "<h5 style=\"margin-top: 0px; margin-bottom: 0px\">Broadcast policy: " << graph->broadcast_err_policy << "</h5>\n\n"
@@ -0,0 +1,394 @@
+//
+// Created by alex on 26/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "utils.h"
+
+TEST(CpuBackend, ProductElementwiseAndSum) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_product";
+    auto a = graph->matrix(md::dType::f32, {2, 3}, "A");
+    auto b = graph->matrix(md::dType::f32, {3, 2}, "B");
+    md::Node product = md::dot(a, b);
+    md::Node scaled = md::tanh(a * graph->constant_value(0.5) + graph->constant_value(1.0));
+    md::Node total = product.sum();
+    md::CpuBackend backend;
+    compile(backend, graph, {a, b}, {product, scaled, total}, {});
+
+    HostArray a_value = range_array(2, 3, 1, 1);
+    HostArray b_value = range_array(3, 2, -1, 0.5);
+    std::vector<HostArray> inputs{a_value, b_value};
+    std::vector<HostArray> outputs = backend.eval(inputs);
+    ASSERT_EQ(outputs.size(), 3);
+    float expected_total = 0;
+    for (long long i = 0; i < 2; i++) {
+        for (long long j = 0; j < 2; j++) {
+            float expected = 0;
+            for (long long k = 0; k < 3; k++) {
+                expected += a_value[i + 2 * k] * b_value[k + 3 * j];
+            }
+            EXPECT_FLOAT_EQ(outputs[0][i + 2 * j], expected);
+            expected_total += expected;
+        }
+    }
+    for (long long i = 0; i < 6; i++) {
+        EXPECT_NEAR(outputs[1][i], std::tanh(a_value[i] * 0.5f + 1.0f), 1e-6);
+    }
+    EXPECT_FLOAT_EQ(outputs[2][0], expected_total);
+}
+
+TEST(CpuBackend, GradientStepUpdatesShared) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_gradient";
+    auto x = graph->matrix(md::dType::f32, {3, 2}, "X");
+    md::Node w = graph->shared_variable(range_array(3, 2, 0.5, 0.25), "W");
+    HostArray w_before = shared_value(w).copy();
+    // The gradient of sum(W * X + W * W) with respect to W is X + 2 W
+    md::Node loss = (w * x + w * w).sum();
+    md::Node grad = graph->gradient(loss, {w})[0];
+    md::CpuBackend backend;
+    compile(backend, graph, {x}, {loss}, {{w, w - graph->constant_value(0.1) * grad}});
+
+    HostArray x_value = range_array(3, 2, 2, -1);
+    std::vector<HostArray> inputs{x_value};
+    std::vector<HostArray> outputs = backend.eval(inputs);
+    float expected_loss = 0;
+    for (long long i = 0; i < 6; i++) {
+        expected_loss += w_before[i] * x_value[i] + w_before[i] * w_before[i];
+        EXPECT_NEAR(shared_value(w)[i], w_before[i] - 0.1f * (x_value[i] + 2 * w_before[i]), 1e-6);
+    }
+    EXPECT_FLOAT_EQ(outputs[0][0], expected_loss);
+}
+
+TEST(CpuBackend, SharedTargetsKeepTheirValueBeforeTheUpdate) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_shared_target";
+    auto x = graph->matrix(md::dType::f32, {2, 2}, "X");
+    md::Node w = graph->shared_variable(HostArray::constant(1, {{2, 2, 1, 1}}), "W");
+    // The reshape is a view of the buffer of the shared variable
+    md::Node flat = w.reshape({4, 1, 1, 1});
+    md::CpuBackend backend;
+    compile(backend, graph, {x}, {w, flat}, {{w, w + x}});
+
+    std::vector<HostArray> inputs{HostArray::constant(10, {{2, 2, 1, 1}})};
+    std::vector<HostArray> first = backend.eval(inputs);
+    std::vector<HostArray> second = backend.eval(inputs);
+    for (long long i = 0; i < 4; i++) {
+        EXPECT_FLOAT_EQ(first[0][i], 1);
+        EXPECT_FLOAT_EQ(first[1][i], 1);
+        EXPECT_FLOAT_EQ(second[0][i], 11);
+        EXPECT_FLOAT_EQ(second[1][i], 11);
+        EXPECT_FLOAT_EQ(shared_value(w)[i], 21);
+    }
+}
+
+TEST(CpuBackend, EvalIntoCallerBuffers) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_into";
+    auto a = graph->matrix(md::dType::f32, {2, 3}, "A");
+    auto b = graph->matrix(md::dType::f32, {3, 2}, "B");
+    md::Node product = md::dot(a, b);
+    md::Node scaled = a * graph->constant_value(2.0);
+    md::Node total = a.sum();
+    md::CpuBackend backend;
+    compile(backend, graph, {a, b}, {product, scaled, total}, {});
+
+    float a_memory[6], b_memory[6], product_memory[4], scaled_memory[6], total_memory[1];
+    for (int i = 0; i < 6; i++) {
+        a_memory[i] = i + 1;
+        b_memory[i] = 1;
+    }
+    std::vector<HostArray> inputs{HostArray::wrap(a_memory, {{2, 3, 1, 1}}), HostArray::wrap(b_memory, {{3, 2, 1, 1}})};
+    std::vector<HostArray> outputs{HostArray::wrap(product_memory, {{2, 2, 1, 1}}),
+                                   HostArray::wrap(scaled_memory, {{2, 3, 1, 1}}),
+                                   HostArray::wrap(total_memory, {{1, 1, 1, 1}})};
+    backend.eval_into(inputs, outputs);
+    // A = [[1, 3, 5], [2, 4, 6]] and B is all ones
+    std::vector<float> expected_product{9, 12, 9, 12};
+    for (int i = 0; i < 4; i++) {
+        EXPECT_FLOAT_EQ(product_memory[i], expected_product[i]);
+    }
+    for (int i = 0; i < 6; i++) {
+        EXPECT_FLOAT_EQ(scaled_memory[i], 2 * a_memory[i]);
+    }
+    EXPECT_FLOAT_EQ(total_memory[0], 21);
+    EXPECT_EQ(outputs[0].data, product_memory);
+
+    // The bound buffers are read and written on every call
+    backend.bind(inputs, outputs);
+    a_memory[0] = 11;
+    backend.eval_bound();
+    EXPECT_FLOAT_EQ(product_memory[0], 19);
+    EXPECT_FLOAT_EQ(scaled_memory[0], 22);
+    EXPECT_FLOAT_EQ(total_memory[0], 31);
+
+    std::vector<HostArray> missing(outputs.begin(), outputs.begin() + 2);
+    EXPECT_THROW(backend.eval_into(inputs, missing), metadiff::exceptions::InvalidArguments);
+    std::vector<HostArray> wrong = outputs;
+    wrong[2] = HostArray(2, 1);
+    EXPECT_THROW(backend.eval_into(inputs, wrong), std::length_error);
+}
+
+/** Runs three steps of sum(W * X) with the update W = W + X, for X = 1, 2 and 3 and W = 1 at the start */
+template <typename B>
+void check_steps(std::string name) {
+    auto graph = md::create_graph();
+    graph->name = name;
+    auto x = graph->matrix(md::dType::f32, {2, 1}, "X");
+    md::Node w = graph->shared_variable(HostArray::constant(1, {{2, 1, 1, 1}}), "W");
+    md::Node loss = (w * x).sum();
+    B backend;
+    compile(backend, graph, {x}, {loss}, {{w, w + x}});
+
+    std::vector<std::vector<HostArray>> batches;
+    for (int step = 1; step <= 3; step++) {
+        batches.push_back({HostArray::constant(step, {{2, 1, 1, 1}})});
+    }
+    // The losses are 2 * 1 * 1, 2 * 2 * 2 and 2 * 4 * 3, after which W = 7
+    std::vector<HostArray> last = backend.eval_steps(batches);
+    ASSERT_EQ(last.size(), 1);
+    EXPECT_FLOAT_EQ(last[0][0], 24);
+    EXPECT_FLOAT_EQ(shared_value(w)[0], 7);
+    EXPECT_FLOAT_EQ(shared_value(w)[1], 7);
+
+    shared_value(w).fill(1);
+    std::vector<HostArray> accumulated = backend.eval_steps(batches, true);
+    EXPECT_FLOAT_EQ(accumulated[0][0], 34);
+    EXPECT_FLOAT_EQ(shared_value(w)[0], 7);
+}
+
+TEST(CpuBackend, EvalSteps) {
+    check_steps<md::CpuBackend>("cpu_steps");
+    // The interpreter runs the steps of a tiered function until it is compiled
+    check_steps<md::InterpreterBackend>("cpu_steps_interpreted");
+}
+
+TEST(CpuBackend, FetchMask) {
+    for (int tiered = 0; tiered < 2; tiered++) {
+        auto graph = md::create_graph();
+        graph->name = "cpu_fetch";
+        auto x = graph->matrix(md::dType::f32, {2, 2}, "X");
+        md::NodeVec inputs{x}, targets{x * graph->constant_value(2.0), x.sum()}, new_inputs, new_targets;
+        md::Updates updates, new_updates;
+        md::Graph optimized = graph->optimize(targets, updates, inputs, new_targets, new_updates, new_inputs);
+        md::CpuBackend backend;
+        backend.tiered = tiered == 1;
+        // The sum is the optional target
+        backend.compile_function(optimized, new_inputs, {new_targets[0]}, new_updates, {new_targets[1]});
+
+        std::vector<HostArray> values{range_array(2, 2, 1, 1)};
+        std::vector<HostArray> fetched = backend.eval(values, {true});
+        ASSERT_EQ(fetched.size(), 2);
+        EXPECT_FLOAT_EQ(fetched[0][3], 8);
+        EXPECT_FLOAT_EQ(fetched[1][0], 10);
+        backend.wait();
+        std::vector<HostArray> skipped = backend.eval(values, {false});
+        ASSERT_EQ(skipped.size(), 2);
+        EXPECT_FLOAT_EQ(skipped[0][3], 8);
+        EXPECT_EQ(skipped[1].elements(), 0);
+        EXPECT_THROW(backend.eval(values, {}), metadiff::exceptions::InvalidArguments);
+        EXPECT_THROW(backend.eval(values, {true, true}), metadiff::exceptions::InvalidArguments);
+    }
+}
+
+TEST(CpuBackend, SharedWorkspace) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_workspace";
+    auto x = graph->matrix(md::dType::f32, {2, 2}, "X");
+    auto y = graph->matrix(md::dType::f32, {2, 2}, "Y");
+    // The reshape is a view of the buffer of the tanh, which both functions compute in the workspace
+    md::Node flat = md::tanh(x).reshape({4, 1, 1, 1});
+    md::Node product = md::dot(md::tanh(x), y);
+    md::NodeVec inputs{x, y}, targets{flat, product}, new_inputs, new_targets;
+    md::Updates updates, new_updates;
+    md::Graph optimized = graph->optimize(targets, updates, inputs, new_targets, new_updates, new_inputs);
+    md::CpuBackend backend;
+    backend.share_workspace = true;
+    backend.compile_functions(optimized, {{new_inputs, {new_targets[0]}, new_updates},
+                                          {new_inputs, {new_targets[1]}, new_updates}});
+
+    std::vector<HostArray> small{HostArray::constant(0.01, {{2, 2, 1, 1}}), HostArray::constant(1, {{2, 2, 1, 1}})};
+    std::vector<HostArray> large{HostArray::constant(2, {{2, 2, 1, 1}}), HostArray::constant(1, {{2, 2, 1, 1}})};
+    std::vector<HostArray> first = backend.eval(small);
+    std::vector<HostArray> second = backend.eval_function(0, large);
+    std::vector<HostArray> third = backend.eval_function(1, large);
+    ASSERT_EQ(first.size(), 1);
+    ASSERT_EQ(third.size(), 1);
+    for (long long i = 0; i < 4; i++) {
+        EXPECT_FLOAT_EQ(first[0][i], std::tanh(0.01f));
+        EXPECT_FLOAT_EQ(second[0][i], std::tanh(2.0f));
+        EXPECT_FLOAT_EQ(third[0][i], 2 * std::tanh(2.0f));
+    }
+    EXPECT_THROW(backend.eval_function(2, large), metadiff::exceptions::CompilationFailed);
+}
+
+/** Throws from eval for an input with a negative first element */
+class FailingBackend : public md::CpuBackend {
+public:
+    ~FailingBackend() {
+        synchronize();
+    }
+
+    std::vector<HostArray> eval(std::vector<HostArray> &inputs) {
+        if (inputs[0][0] < 0) {
+            throw std::domain_error("Negative input");
+        }
+        return md::CpuBackend::eval(inputs);
+    }
+};
+
+TEST(CpuBackend, EvalAsync) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_async";
+    auto x = graph->matrix(md::dType::f32, {2, 1}, "X");
+    md::Node w = graph->shared_variable(HostArray::constant(1, {{2, 1, 1, 1}}), "W");
+    {
+        FailingBackend backend;
+        compile(backend, graph, {x}, {w.sum()}, {{w, w * graph->constant_value(2.0) + x}});
+        std::vector<std::future<std::vector<HostArray>>> results;
+        for (int step = 1; step <= 3; step++) {
+            results.push_back(backend.eval_async({HostArray::constant(step, {{2, 1, 1, 1}})}));
+        }
+        std::future<std::vector<HostArray>> failed = backend.eval_async({HostArray::constant(-1, {{2, 1, 1, 1}})});
+        backend.eval_async({HostArray::constant(4, {{2, 1, 1, 1}})});
+        // Each call sees the update of the one before, W = 1, 3 and 8
+        EXPECT_FLOAT_EQ(results[0].get()[0][0], 2);
+        EXPECT_FLOAT_EQ(results[1].get()[0][0], 6);
+        EXPECT_FLOAT_EQ(results[2].get()[0][0], 16);
+        EXPECT_THROW(failed.get(), std::domain_error);
+    }
+    // The destructor waits for the last call, which updates W = 19 to 2 * 19 + 4
+    EXPECT_FLOAT_EQ(shared_value(w)[0], 42);
+    EXPECT_FLOAT_EQ(shared_value(w)[1], 42);
+}
+
+TEST(CpuBackend, SpecializedVariants) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_specialized";
+    md::SymInt n = graph->get_new_symbolic_integer();
+    auto x = graph->matrix(md::dType::f32, n, 3, "X");
+    md::Node total = md::tanh(x).sum();
+    md::CpuBackend backend;
+    backend.specialize({{n, 4}});
+    compile(backend, graph, {x}, {total}, {});
+    ASSERT_EQ(backend.variant_funcs.size(), 1);
+    ASSERT_NE(backend.variant_funcs[0], nullptr);
+
+    for (long long rows = 3; rows <= 5; rows++) {
+        std::vector<HostArray> inputs{range_array(rows, 3, -1, 0.1)};
+        // Only the batch size of the variant runs it
+        EXPECT_EQ(backend.select_variant(inputs, backend.eval_func),
+                  rows == 4 ? backend.variant_funcs[0] : backend.eval_func);
+        float expected = 0;
+        for (long long i = 0; i < rows * 3; i++) {
+            expected += std::tanh(inputs[0][i]);
+        }
+        EXPECT_NEAR(backend.eval(inputs)[0][0], expected, 1e-5);
+    }
+
+    // The symbolic integers can only be bound from the dimensions of the inputs
+    md::SymInt m = graph->get_new_symbolic_integer();
+    md::CpuBackend unbound;
+    unbound.specialize({{m, 4}});
+    EXPECT_THROW(compile(unbound, graph, {x}, {total}, {}), metadiff::exceptions::CompilationFailed);
+    EXPECT_THROW(unbound.specialize({{2 * n, 8}}), metadiff::exceptions::CompilationFailed);
+}
+
+TEST(CpuBackend, SymbolicIntegersBoundOnEveryCall) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_batch_size";
+    md::SymInt n = graph->get_new_symbolic_integer();
+    auto x = graph->matrix(md::dType::f32, n, 3, "X");
+    // The mean divides by 3 n, which is computed once by the prologue
+    md::Node mean = x.sum() / graph->wrap(3 * n);
+    md::Node scaled = x * graph->wrap(n);
+    md::CpuBackend backend;
+    compile(backend, graph, {x}, {mean, scaled}, {});
+    metadiff::backend::FunctionBackend<HostArray>::func_ptr compiled = backend.eval_func;
+
+    for (long long rows = 1; rows <= 7; rows += 3) {
+        std::vector<HostArray> inputs{range_array(rows, 3, 0, 1)};
+        std::vector<HostArray> outputs = backend.eval(inputs);
+        // The elements are 0, 1, ..., 3 n - 1
+        EXPECT_FLOAT_EQ(outputs[0][0], (3 * rows - 1) / 2.0f);
+        ASSERT_EQ(outputs[1].elements(), 3 * rows);
+        EXPECT_FLOAT_EQ(outputs[1][3 * rows - 1], rows * (3 * rows - 1));
+    }
+    EXPECT_EQ(backend.eval_func, compiled);
+}
+
+TEST(CpuBackend, TieredSwitchesToCompiled) {
+    auto graph = md::create_graph();
+    graph->name = "cpu_tiered";
+    auto x = graph->matrix(md::dType::f32, {4, 3}, "X");
+    md::Node scale = graph->hyperparameter(1.0, "scale");
+    md::Node scaled = md::tanh(x * scale);
+    md::Node total = scaled.sum();
+    md::CpuBackend backend;
+    backend.tiered = true;
+    compile(backend, graph, {x}, {scaled, total}, {});
+    // Set while the library is compiled, thus it must reach both the interpreter and the linked library
+    backend.set_hyperparameter(scale, 0.5);
+
+    HostArray x_value = range_array(4, 3, -3, 0.5);
+    std::vector<HostArray> inputs{x_value};
+    std::vector<HostArray> interpreted = backend.eval(inputs);
+    backend.wait();
+    ASSERT_TRUE(backend.is_compiled());
+    std::vector<HostArray> compiled = backend.eval(inputs);
+    ASSERT_EQ(compiled.size(), 2);
+    for (long long i = 0; i < 12; i++) {
+        EXPECT_NEAR(interpreted[0][i], std::tanh(0.5f * x_value[i]), 1e-6);
+        EXPECT_NEAR(compiled[0][i], interpreted[0][i], 1e-6);
+    }
+    EXPECT_NEAR(compiled[1][0], interpreted[1][0], 1e-5);
+}
+
+TEST(CpuBackend, ProfileGuidedRebuild) {
+    for (int tiered = 0; tiered < 2; tiered++) {
+        auto graph = md::create_graph();
+        graph->name = "cpu_pgo";
+        auto x = graph->matrix(md::dType::f32, {4, 3}, "X");
+        md::Node scaled = md::tanh(x * graph->constant_value(2.0));
+        md::CpuBackend backend;
+        backend.tiered = tiered == 1;
+        backend.pgo_steps = 2;
+        compile(backend, graph, {x}, {scaled}, {});
+        backend.wait();
+
+        HostArray x_value = range_array(4, 3, -1, 0.25);
+        std::vector<HostArray> inputs{x_value};
+        metadiff::backend::FunctionBackend<HostArray>::func_ptr instrumented = backend.eval_func;
+        for (int step = 0; step < 3; step++) {
+            std::vector<HostArray> outputs = backend.eval(inputs);
+            for (long long i = 0; i < 12; i++) {
+                EXPECT_NEAR(outputs[0][i], std::tanh(2 * x_value[i]), 1e-6);
+            }
+            // In tiered mode the calls keep running the instrumented library until the rebuild is linked
+            backend.wait();
+        }
+        std::vector<std::string> files = metadiff::os::list_files(metadiff::os::join_paths(backend.dir_path, "lib"));
+        EXPECT_EQ(std::count_if(files.begin(), files.end(), [](std::string const &file) {
+            return file.size() > 7 and file.substr(file.size() - 7) == "_pgo.so";
+        }), 1);
+        EXPECT_NE(backend.eval_func, instrumented);
+    }
+}
+
+TEST(CpuBackend, InstructionSets) {
+    md::CpuBackend backend;
+    std::vector<metadiff::backend::instructionSet> isas = backend.build_isas();
+    ASSERT_EQ(isas.size(), 1);
+    EXPECT_EQ(isas[0], metadiff::backend::host_isa());
+    // A portable build can always be linked
+    backend.target_isas = {metadiff::backend::AVX2, metadiff::backend::AVX512};
+    isas = backend.build_isas();
+    EXPECT_EQ(isas.size(), 3);
+    EXPECT_EQ(isas.back(), metadiff::backend::GENERIC);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,180 @@
+//
+// Created by alex on 26/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "utils.h"
+
+TEST(InterpreterBackend, Elementwise) {
+    auto graph = md::create_graph();
+    graph->name = "interpreter_elementwise";
+    auto a = graph->matrix(md::dType::f32, {2, 3}, "A");
+    auto b = graph->matrix(md::dType::f32, {2, 3}, "B");
+    md::Node mixed = md::exp(a) * b - md::square(b) / a;
+    md::Node larger = md::select(a > b, a, b);
+    md::InterpreterBackend backend;
+    compile(backend, graph, {a, b}, {mixed, larger}, {});
+
+    HostArray a_value = range_array(2, 3, 0.5, 0.5);
+    HostArray b_value = range_array(2, 3, 2, -0.5);
+    std::vector<HostArray> inputs{a_value, b_value};
+    std::vector<HostArray> outputs = backend.eval(inputs);
+    ASSERT_EQ(outputs.size(), 2);
+    for (long long i = 0; i < 6; i++) {
+        float x = a_value[i];
+        float y = b_value[i];
+        EXPECT_NEAR(outputs[0][i], std::exp(x) * y - y * y / x, 1e-5);
+        EXPECT_FLOAT_EQ(outputs[1][i], std::max(x, y));
+    }
+}
+
+TEST(InterpreterBackend, ProductAndSum) {
+    auto graph = md::create_graph();
+    graph->name = "interpreter_product";
+    auto a = graph->matrix(md::dType::f32, {3, 2}, "A");
+    auto b = graph->matrix(md::dType::f32, {3, 4}, "B");
+    // The transpose is passed to the product as a flag
+    md::Node product = md::dot(a.transpose(), b);
+    md::Node columns = b.sum({0});
+    md::Node total = b.sum();
+    md::InterpreterBackend backend;
+    compile(backend, graph, {a, b}, {product, columns, total}, {});
+
+    HostArray a_value = range_array(3, 2, 1, 1);
+    HostArray b_value = range_array(3, 4, -2, 0.5);
+    std::vector<HostArray> inputs{a_value, b_value};
+    std::vector<HostArray> outputs = backend.eval(inputs);
+    ASSERT_EQ(outputs.size(), 3);
+    // A^T = [[1, 2, 3], [4, 5, 6]] and the columns of B are [-2, -1.5, -1], [-0.5, 0, 0.5], ...
+    std::vector<float> expected_product{-8, -21.5, 1, 1, 10, 23.5, 19, 46};
+    std::vector<float> expected_columns{-4.5, 0, 4.5, 9};
+    for (long long i = 0; i < 8; i++) {
+        EXPECT_FLOAT_EQ(outputs[0][i], expected_product[i]);
+    }
+    for (long long i = 0; i < 4; i++) {
+        EXPECT_FLOAT_EQ(outputs[1][i], expected_columns[i]);
+    }
+    EXPECT_FLOAT_EQ(outputs[2][0], 9);
+}
+
+TEST(InterpreterBackend, GradientStepUpdatesShared) {
+    auto graph = md::create_graph();
+    graph->name = "interpreter_gradient";
+    auto x = graph->matrix(md::dType::f32, {2, 2}, "X");
+    md::Node w = graph->shared_variable(range_array(2, 2, 1, 1), "W");
+    // The gradient of sum(W * W * X) with respect to W is 2 W X
+    md::Node loss = (w * w * x).sum();
+    md::Node grad = graph->gradient(loss, {w})[0];
+    md::InterpreterBackend backend;
+    compile(backend, graph, {x}, {loss, grad}, {{w, w - graph->constant_value(0.5) * grad}});
+
+    HostArray x_value = range_array(2, 2, 1, -1);
+    std::vector<HostArray> inputs{x_value};
+    std::vector<HostArray> outputs = backend.eval(inputs);
+    // W = [1, 2, 3, 4] and X = [1, 0, -1, -2]
+    std::vector<float> expected_grad{2, 0, -6, -16};
+    std::vector<float> expected_w{0, 2, 6, 12};
+    EXPECT_FLOAT_EQ(outputs[0][0], -40);
+    for (long long i = 0; i < 4; i++) {
+        EXPECT_FLOAT_EQ(outputs[1][i], expected_grad[i]);
+        EXPECT_FLOAT_EQ(shared_value(w)[i], expected_w[i]);
+    }
+}
+
+TEST(InterpreterBackend, SharedTargetsKeepTheirValueBeforeTheUpdate) {
+    auto graph = md::create_graph();
+    graph->name = "interpreter_shared_target";
+    auto x = graph->matrix(md::dType::f32, {2, 2}, "X");
+    md::Node w = graph->shared_variable(HostArray::constant(1, {{2, 2, 1, 1}}), "W");
+    md::Node flat = w.reshape({4, 1, 1, 1});
+    md::InterpreterBackend backend;
+    compile(backend, graph, {x}, {w, flat}, {{w, w + x}});
+
+    std::vector<HostArray> inputs{HostArray::constant(10, {{2, 2, 1, 1}})};
+    std::vector<HostArray> first = backend.eval(inputs);
+    std::vector<HostArray> second = backend.eval(inputs);
+    for (long long i = 0; i < 4; i++) {
+        EXPECT_FLOAT_EQ(first[0][i], 1);
+        EXPECT_FLOAT_EQ(first[1][i], 1);
+        EXPECT_FLOAT_EQ(second[0][i], 11);
+        EXPECT_FLOAT_EQ(second[1][i], 11);
+        EXPECT_FLOAT_EQ(shared_value(w)[i], 21);
+    }
+}
+
+TEST(InterpreterBackend, ShapeOperators) {
+    auto graph = md::create_graph();
+    graph->name = "interpreter_shape";
+    auto a = graph->matrix(md::dType::f32, {3, 3}, "A");
+    auto v = graph->vector(md::dType::f32, 2, "v");
+    md::Node diagonal = md::diag(a);
+    md::Node diagonal_matrix = md::diag(v);
+    md::Node trace = md::trace(a);
+    md::Node reordered = md::reorder(a, 1, 0);
+    md::Node sequence = graph->seq(2, 4) + v;
+    md::InterpreterBackend backend;
+    compile(backend, graph, {a, v}, {diagonal, diagonal_matrix, trace, reordered, sequence}, {});
+
+    HostArray a_value = range_array(3, 3, 0, 1);
+    HostArray v_value = range_array(2, 1, 5, 2);
+    std::vector<HostArray> inputs{a_value, v_value};
+    std::vector<HostArray> outputs = backend.eval(inputs);
+    ASSERT_EQ(outputs.size(), 5);
+    std::vector<float> expected_diagonal{0, 4, 8};
+    std::vector<float> expected_matrix{5, 0, 0, 7};
+    for (long long i = 0; i < 3; i++) {
+        EXPECT_FLOAT_EQ(outputs[0][i], expected_diagonal[i]);
+        for (long long j = 0; j < 3; j++) {
+            EXPECT_FLOAT_EQ(outputs[3][i + 3 * j], a_value[j + 3 * i]);
+        }
+    }
+    for (long long i = 0; i < 4; i++) {
+        EXPECT_FLOAT_EQ(outputs[1][i], expected_matrix[i]);
+    }
+    EXPECT_FLOAT_EQ(outputs[2][0], 12);
+    EXPECT_FLOAT_EQ(outputs[4][0], 7);
+    EXPECT_FLOAT_EQ(outputs[4][1], 10);
+}
+
+TEST(InterpreterBackend, UnsupportedOperator) {
+    auto graph = md::create_graph();
+    graph->name = "interpreter_unsupported";
+    auto a = graph->matrix(md::dType::f32, {2, 2}, "A");
+    md::InterpreterBackend backend;
+    EXPECT_THROW(compile(backend, graph, {a}, {md::det(a)}, {}), metadiff::exceptions::CompilationFailed);
+}
+
+TEST(InterpreterBackend, MemoryLimit) {
+    auto graph = md::create_graph();
+    graph->name = "interpreter_memory";
+    auto x = graph->matrix(md::dType::f32, 100, 10, "X");
+    md::Node y = md::tanh(x) + x;
+    md::InterpreterBackend backend;
+    // The input and the result take 4000 bytes each
+    backend.memory_limit = 7999;
+    EXPECT_THROW(compile(backend, graph, {x}, {y}, {}), metadiff::exceptions::MemoryLimitExceeded);
+    backend.memory_limit = 8000;
+    compile(backend, graph, {x}, {y}, {});
+    std::vector<HostArray> inputs{range_array(100, 10, 0, 0.01)};
+    EXPECT_EQ(backend.eval(inputs)[0].elements(), 1000);
+}
+
+TEST(InterpreterBackend, DoesNotCreateTheCache) {
+    char const *previous = getenv("METADIFF_CACHE");
+    std::string saved = previous ? previous : "";
+    std::string cache = metadiff::os::make_temp_dir() + "/cache";
+    setenv("METADIFF_CACHE", cache.c_str(), 1);
+    // Only the precompiled headers of the compiled backends are cached
+    md::InterpreterBackend backend;
+    EXPECT_FALSE(metadiff::os::exists(cache));
+    if (previous) {
+        setenv("METADIFF_CACHE", saved.c_str(), 1);
+    } else {
+        unsetenv("METADIFF_CACHE");
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
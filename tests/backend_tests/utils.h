@@ -0,0 +1,42 @@
+//
+// Created by alex on 26/10/16.
+//
+
+#ifndef METADIFF_TESTS_BACKEND_UTILS_H
+#define METADIFF_TESTS_BACKEND_UTILS_H
+
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "metadiff.h"
+
+namespace md = metadiff::api;
+using metadiff::kernels::HostArray;
+
+/** An array with the elements start, start + step, ... in column major order */
+inline HostArray range_array(long long rows, long long cols, float start, float step) {
+    HostArray result(rows, cols);
+    for (long long i = 0; i < result.elements(); i++) {
+        result[i] = start + step * i;
+    }
+    return result;
+}
+
+/** The value of the shared variable of the node */
+inline HostArray &shared_value(md::Node node) {
+    auto var = std::static_pointer_cast<metadiff::op::SharedInput>(node->op)->var;
+    return std::static_pointer_cast<metadiff::shared::HostVariable>(var)->value;
+}
+
+/** Optimizes the graph and compiles the function */
+template <typename B>
+void compile(B &backend, md::Graph graph, md::NodeVec inputs, md::NodeVec targets, md::Updates updates) {
+    md::NodeVec new_inputs, new_targets;
+    md::Updates new_updates;
+    md::Graph optimized = graph->optimize(targets, updates, inputs, new_targets, new_updates, new_inputs);
+    backend.compile_function(optimized, new_inputs, new_targets, new_updates);
+}
+
+#endif //METADIFF_TESTS_BACKEND_UTILS_H
@@ -0,0 +1,205 @@
+//
+// Created by alex on 27/10/16.
+//
+
+#include "gtest/gtest.h"
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include "metadiff.h"
+
+namespace md = metadiff::api;
+
+/** A new empty file in the temporary directory */
+std::string temp_file() {
+    char path[] = "/tmp/metadiff_test_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    return path;
+}
+
+/** Optimizes the graph for the targets, without any updates */
+md::Graph optimized(md::Graph graph, md::NodeVec inputs, md::NodeVec targets) {
+    md::NodeVec new_inputs, new_targets;
+    md::Updates updates, new_updates;
+    return graph->optimize(targets, updates, inputs, new_targets, new_updates, new_inputs);
+}
+
+/** Exp(X) with two children, which the heuristic does not inline */
+md::Graph shared_exp_graph(md::NodeVec &inputs, md::NodeVec &targets) {
+    auto graph = md::create_graph();
+    graph->name = "shared_exp";
+    auto x = graph->matrix(md::dType::f32, {100, 100}, "X");
+    md::Node e = md::exp(x);
+    inputs = {x};
+    targets = {e + x, e * x};
+    return graph;
+}
+
+TEST(Profile, SaveAndLoadRoundTrip) {
+    md::NodeVec inputs, targets;
+    md::Graph graph = shared_exp_graph(inputs, targets);
+    graph->profile_db = temp_file();
+    md::Graph first = optimized(graph, inputs, targets);
+    ASSERT_FALSE(first->load_profile());
+    for (size_t i = 0; i < first->nodes.size(); i++) {
+        if (i % 2 == 0) {
+            first->nodes[i]->execution.time = 1e-6 * (i + 1);
+            first->nodes[i]->execution.bytes = 1000 * (i + 1);
+        }
+    }
+    first->save_profile();
+
+    // Entries of other graphs are kept
+    auto other = md::create_graph();
+    other->profile_db = graph->profile_db;
+    auto y = other->vector(md::dType::f32, 3, "y");
+    md::Node z = md::tanh(y);
+    md::Graph other_optimized = optimized(other, {y}, {z});
+    other_optimized->nodes[0]->execution.time = 1;
+    other_optimized->nodes[0]->execution.bytes = 12;
+    other_optimized->save_profile();
+
+    md::Graph second = optimized(graph, inputs, targets);
+    ASSERT_EQ(second->structural_hash(), first->structural_hash());
+    ASSERT_TRUE(second->load_profile());
+    for (size_t i = 0; i < second->nodes.size(); i++) {
+        EXPECT_DOUBLE_EQ(second->nodes[i]->execution.time, first->nodes[i]->execution.time);
+        EXPECT_EQ(second->nodes[i]->execution.bytes, first->nodes[i]->execution.bytes);
+    }
+    md::Graph other_second = optimized(other, {y}, {z});
+    ASSERT_TRUE(other_second->load_profile());
+    EXPECT_DOUBLE_EQ(other_second->nodes[0]->execution.time, 1);
+    std::remove(graph->profile_db.c_str());
+}
+
+TEST(Profile, MeasuredInlineUsesMedianBandwidth) {
+    md::NodeVec inputs, targets;
+    md::Graph graph = shared_exp_graph(inputs, targets);
+    graph->profile_db = temp_file();
+    md::Graph measured = optimized(graph, inputs, targets);
+    md::Node e;
+    for (size_t i = 0; i < measured->nodes.size(); i++) {
+        if (measured->nodes[i]->op->name == "Exp") {
+            e = measured->nodes[i];
+        }
+        // Every node moves 40000 bytes in 10 us
+        measured->nodes[i]->execution.time = 1e-5;
+        measured->nodes[i]->execution.bytes = 40000;
+    }
+    ASSERT_TRUE(e.ptr.lock() != nullptr);
+    ASSERT_FALSE(e->execution.inlined);
+    // A single node which stayed in the cache would make storing Exp look cheaper than computing it twice
+    measured->nodes[0]->execution.time = 1e-9;
+    measured->save_profile();
+
+    md::Graph second = optimized(graph, inputs, targets);
+    for (size_t i = 0; i < second->nodes.size(); i++) {
+        if (second->nodes[i]->op->name == "Exp") {
+            EXPECT_TRUE(second->nodes[i]->execution.inlined);
+        }
+    }
+    std::remove(graph->profile_db.c_str());
+}
+
+TEST(Cost, MatrixProduct) {
+    auto graph = md::create_graph();
+    md::SymInt n = graph->get_new_symbolic_integer();
+    auto a = graph->matrix(md::dType::f32, n, 3, "A");
+    auto b = graph->matrix(md::dType::f32, 3, 4, "B");
+    auto c = graph->matrix(md::dType::f32, 4, 5, "C");
+    md::OperatorCost product = md::dot(a, b)->op->cost();
+    EXPECT_EQ(product.flops, 24 * n);
+    EXPECT_EQ(product.bytes_read, 4 * (3 * n + 12));
+    EXPECT_EQ(product.bytes_written, 16 * n);
+    EXPECT_EQ(product.transcendentals, 0);
+    // Evaluated left to right, as (A B) C, thus 2 n 3 4 + 2 n 4 5 flops
+    md::Node chain = md::dot(md::NodeVec{a, b, c});
+    ASSERT_EQ(chain->op->get_parents().size(), 3);
+    md::OperatorCost chain_cost = chain->op->cost();
+    EXPECT_EQ(chain_cost.flops, 64 * n);
+    EXPECT_EQ(chain_cost.bytes_read, 4 * (3 * n + 12 + 20));
+    EXPECT_EQ(chain_cost.bytes_written, 20 * n);
+}
+
+TEST(Cost, SumAlongAxis) {
+    auto graph = md::create_graph();
+    md::SymInt n = graph->get_new_symbolic_integer();
+    md::SymInt m = graph->get_new_symbolic_integer();
+    auto x = graph->matrix(md::dType::f32, n, m, "X");
+    md::OperatorCost cost = x.sum({1})->op->cost();
+    EXPECT_EQ(cost.flops, n * m);
+    EXPECT_EQ(cost.bytes_read, 4 * n * m);
+    EXPECT_EQ(cost.bytes_written, 4 * n);
+}
+
+TEST(Cost, Broadcast) {
+    auto graph = md::create_graph();
+    md::SymInt n = graph->get_new_symbolic_integer();
+    md::SymInt m = graph->get_new_symbolic_integer();
+    auto v = graph->vector(md::dType::f32, n, "v");
+    md::Node broadcasted = v.broadcast({n, m, 1, 1});
+    ASSERT_EQ(broadcasted->op->name, "Broadcast");
+    md::OperatorCost cost = broadcasted->op->cost();
+    EXPECT_EQ(cost.flops, 0);
+    EXPECT_EQ(cost.bytes_read, 4 * n);
+    EXPECT_EQ(cost.bytes_written, 4 * n * m);
+}
+
+TEST(Cost, ElementwiseOnSymbolicShapes) {
+    auto graph = md::create_graph();
+    md::SymInt n = graph->get_new_symbolic_integer();
+    md::SymInt m = graph->get_new_symbolic_integer();
+    auto x = graph->matrix(md::dType::f32, n, m, "X");
+    auto y = graph->matrix(md::dType::f32, n, m, "Y");
+    auto z = graph->matrix(md::dType::f32, n, m, "Z");
+    md::OperatorCost sum = md::Node::add(md::NodeVec{x, y, z})->op->cost();
+    EXPECT_EQ(sum.flops, 2 * n * m);
+    EXPECT_EQ(sum.bytes_read, 12 * n * m);
+    EXPECT_EQ(sum.bytes_written, 4 * n * m);
+    EXPECT_EQ(sum.transcendentals, 0);
+    md::OperatorCost tanh = md::tanh(x)->op->cost();
+    EXPECT_EQ(tanh.flops, 0);
+    EXPECT_EQ(tanh.transcendentals, n * m);
+    EXPECT_EQ(tanh.bytes_read, 4 * n * m);
+    // For n = 10 and m = 20 the total cost of the graph is that of its three operators
+    md::OperatorCost total = graph->total_cost().eval({10, 20});
+    EXPECT_EQ(total.flops.constant_value(), 400);
+    EXPECT_EQ(total.transcendentals.constant_value(), 200);
+}
+
+TEST(Memory, PeakBreakdown) {
+    auto graph = md::create_graph();
+    auto x = graph->matrix(md::dType::f32, 8, 10, "X");
+    md::Node w = graph->shared_variable(metadiff::kernels::HostArray(10, 2), "W");
+    md::Node loss = md::tanh(md::dot(x, w)).sum();
+    md::Node grad = graph->gradient(loss, {w})[0];
+    md::MemoryEstimate estimate = graph->estimate_memory({loss, grad}, {});
+    // The peak is at the transpose of X for the gradient, while X, the gradient of the product and
+    // the loss are still live, while the tanh and the rest of the forward nodes are already freed
+    ASSERT_EQ(graph->nodes[estimate.peak_node]->op->name, "Transpose");
+    EXPECT_EQ(estimate.parameters, 80);
+    EXPECT_EQ(estimate.activations, 320);
+    EXPECT_EQ(estimate.gradients, 320 + 64);
+    EXPECT_EQ(estimate.temporaries, 4);
+    EXPECT_EQ(estimate.peak(), 788);
+    ASSERT_EQ(estimate.contributors.size(), 4);
+    EXPECT_EQ(estimate.contributors[0], std::make_pair(x->id, 320LL));
+}
+
+TEST(Memory, SymbolicIntegersTakeTheGivenValues) {
+    auto graph = md::create_graph();
+    md::SymInt n = graph->get_new_symbolic_integer();
+    auto x = graph->matrix(md::dType::f32, n, 10, "X");
+    md::Node y = md::tanh(x);
+    EXPECT_EQ(graph->estimate_memory({y}, {100}).peak(), 8000);
+    EXPECT_EQ(graph->estimate_memory({y}, {1000}).peak(), 80000);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
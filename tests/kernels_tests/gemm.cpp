@@ -0,0 +1,106 @@
+//
+// Created by alex on 14/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "kernels.h"
+#include <random>
+
+using metadiff::kernels::HostArray;
+
+HostArray random_array(long long rows, long long cols, std::mt19937 &generator) {
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    HostArray result(rows, cols);
+    for (long long i = 0; i < result.elements(); i++) {
+        result[i] = distribution(generator);
+    }
+    return result;
+}
+
+/** Naive triple loop product, with the same transpose conventions as matmul */
+HostArray reference_matmul(HostArray const &a, HostArray const &b, bool trans_a, bool trans_b) {
+    long long m = trans_a ? a.dims[1] : a.dims[0];
+    long long k = trans_a ? a.dims[0] : a.dims[1];
+    long long n = trans_b ? b.dims[0] : b.dims[1];
+    HostArray result(m, n);
+    for (long long i = 0; i < m; i++) {
+        for (long long j = 0; j < n; j++) {
+            double value = 0;
+            for (long long p = 0; p < k; p++) {
+                float a_ip = trans_a ? a[p + i * a.dims[0]] : a[i + p * a.dims[0]];
+                float b_pj = trans_b ? b[j + p * b.dims[0]] : b[p + j * b.dims[0]];
+                value += a_ip * b_pj;
+            }
+            result[i + j * m] = value;
+        }
+    }
+    return result;
+}
+
+TEST(GemmTest, MatchesReference){
+    std::mt19937 generator(42);
+    // Sizes chosen to cover partial micro tiles as well as several cache blocks
+    std::vector<long long> sizes = {1, 7, 33, 130, 300};
+    for (int trans_a = 0; trans_a < 2; trans_a++) {
+        for (int trans_b = 0; trans_b < 2; trans_b++) {
+            for (auto m : sizes) {
+                for (auto n : sizes) {
+                    long long k = m + n;
+                    HostArray a = trans_a ? random_array(k, m, generator) : random_array(m, k, generator);
+                    HostArray b = trans_b ? random_array(n, k, generator) : random_array(k, n, generator);
+                    HostArray result = metadiff::kernels::matmul(a, b, trans_a, trans_b);
+                    HostArray expected = reference_matmul(a, b, trans_a, trans_b);
+                    ASSERT_EQ(result.dims, expected.dims);
+                    for (long long i = 0; i < expected.elements(); i++) {
+                        ASSERT_NEAR(result[i], expected[i], 1e-3) << "m=" << m << " n=" << n << " k=" << k
+                                                                  << " trans_a=" << trans_a << " trans_b=" << trans_b;
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(GemmTest, AlphaBeta){
+    std::mt19937 generator(7);
+    HostArray a = random_array(45, 20, generator);
+    HostArray b = random_array(20, 13, generator);
+    HostArray c = random_array(45, 13, generator);
+    HostArray expected = reference_matmul(a, b, false, false);
+    for (long long i = 0; i < expected.elements(); i++) {
+        expected[i] = 2 * expected[i] + 0.5f * c[i];
+    }
+    metadiff::kernels::gemm(false, false, 45, 13, 20, 2.0f, a.data, 45, b.data, 20, 0.5f, c.data, 45);
+    for (long long i = 0; i < expected.elements(); i++) {
+        EXPECT_NEAR(c[i], expected[i], 1e-3);
+    }
+}
+
+TEST(KernelsTest, SumAndTranspose){
+    HostArray a(3, 4, 2);
+    for (long long i = 0; i < a.elements(); i++) {
+        a[i] = i;
+    }
+    HostArray rows = metadiff::kernels::sum(a, {1});
+    EXPECT_EQ(rows.dims, (metadiff::kernels::HostDims{{3, 1, 2, 1}}));
+    EXPECT_EQ(rows[0], 0 + 3 + 6 + 9);
+    EXPECT_EQ(rows[5], 14 + 17 + 20 + 23);
+    EXPECT_EQ(metadiff::kernels::sum(a)[0], 276);
+
+    HostArray b(3, 5);
+    for (long long i = 0; i < b.elements(); i++) {
+        b[i] = i;
+    }
+    HostArray t = metadiff::kernels::transpose(b);
+    EXPECT_EQ(t.dims, (metadiff::kernels::HostDims{{5, 3, 1, 1}}));
+    for (long long i = 0; i < 3; i++) {
+        for (long long j = 0; j < 5; j++) {
+            EXPECT_EQ(t[j + i * 5], b[i + j * 3]);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
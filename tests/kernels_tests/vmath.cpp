@@ -0,0 +1,54 @@
+//
+// Created by alex on 15/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "kernels.h"
+#include <cmath>
+
+namespace vmath = metadiff::kernels::vmath;
+
+/** Maximum relative error of f against the double precision reference g on [low, high] */
+template <typename F, typename G>
+double max_relative_error(F f, G g, double low, double high) {
+    double result = 0;
+    for (int i = 0; i <= 100000; i++) {
+        float x = float(low + (high - low) * i / 100000.0);
+        double expected = g(double(x));
+        if (expected != 0) {
+            result = std::max(result, std::fabs((f(x) - expected) / expected));
+        }
+    }
+    return result;
+}
+
+TEST(VmathTest, Precise){
+    EXPECT_LT(max_relative_error(vmath::exp, [](double x) { return std::exp(x); }, -80, 80), 2e-7);
+    EXPECT_LT(max_relative_error(vmath::log, [](double x) { return std::log(x); }, 1e-30, 1e4), 2e-7);
+    EXPECT_LT(max_relative_error(vmath::log1p, [](double x) { return std::log1p(x); }, -0.99, 10), 2e-7);
+    EXPECT_LT(max_relative_error(vmath::log1p, [](double x) { return std::log1p(x); }, -1e-5, 1e-5), 2e-7);
+    EXPECT_LT(max_relative_error(vmath::tanh, [](double x) { return std::tanh(x); }, -20, 20), 2e-7);
+}
+
+TEST(VmathTest, Fast){
+    EXPECT_LT(max_relative_error(vmath::fast::exp, [](double x) { return std::exp(x); }, -80, 80), 1e-5);
+    EXPECT_LT(max_relative_error(vmath::fast::log, [](double x) { return std::log(x); }, 1e-30, 1e4), 1e-5);
+    EXPECT_LT(max_relative_error(vmath::fast::log1p, [](double x) { return std::log1p(x); }, -0.99, 10), 1e-5);
+    EXPECT_LT(max_relative_error(vmath::fast::tanh, [](double x) { return std::tanh(x); }, -20, 20), 1e-5);
+}
+
+TEST(VmathTest, SpecialValues){
+    float inf = std::numeric_limits<float>::infinity();
+    EXPECT_EQ(vmath::exp(inf), inf);
+    EXPECT_EQ(vmath::exp(-inf), 0);
+    EXPECT_EQ(vmath::exp(100), inf);
+    EXPECT_TRUE(std::isnan(vmath::exp(NAN)));
+    EXPECT_TRUE(std::isnan(vmath::fast::exp(NAN)));
+    EXPECT_TRUE(std::isnan(vmath::tanh(NAN)));
+    EXPECT_EQ(vmath::log(0), -inf);
+    EXPECT_EQ(vmath::log(inf), inf);
+    EXPECT_TRUE(std::isnan(vmath::log(-1)));
+    EXPECT_EQ(vmath::log1p(-1), -inf);
+    EXPECT_EQ(vmath::tanh(inf), 1);
+    EXPECT_EQ(vmath::tanh(-inf), -1);
+}
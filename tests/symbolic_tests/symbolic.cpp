@@ -251,6 +251,52 @@ TYPED_TEST(SymbolicTest, PolynomialProductAndDivision) {
     EXPECT_THROW(product / x*x, metadiff::symbolic::NonIntegerDivision);
 }
 
+TYPED_TEST(SymbolicTest, PolynomialCanonical) {
+    typedef metadiff::symbolic::SymbolicPolynomial<TypeParam, TypeParam> Polynomial;
+    auto x = Polynomial::variable(0);
+    auto y = Polynomial::variable(1);
+    auto z = Polynomial::variable(2);
+
+    // Equal polynomials built in a different order share the hash
+    auto sum = x + y + z + 1;
+    auto sum_2 = 1 + z + (y + x);
+    EXPECT_EQ(sum, sum_2);
+    EXPECT_EQ(sum.hash(), sum_2.hash());
+    EXPECT_EQ(sum.monomials.size(), 4);
+
+    // Zero monomials are dropped
+    EXPECT_EQ(x * 0, 0);
+    EXPECT_EQ((x + 2) - x, 2);
+    EXPECT_TRUE(((x + 2) - x).is_constant());
+
+    // Monomials merged by canonicalize
+    auto edited = Polynomial(x);
+    edited.monomials.push_back(x.monomials[0]);
+    edited.monomials.push_back(y.monomials[0]);
+    edited.canonicalize();
+    EXPECT_EQ(edited, 2 * x + y);
+}
+
+TYPED_TEST(SymbolicTest, PolynomialRange) {
+    typedef metadiff::symbolic::SymbolicPolynomial<TypeParam, TypeParam> Polynomial;
+    typedef metadiff::symbolic::SymbolicRange Range;
+    auto x = Polynomial::variable(0);
+    auto y = Polynomial::variable(1);
+    std::vector<Range> ranges = {Range(1, 4096, 1024), Range(2, 3)};
+
+    EXPECT_EQ(metadiff::symbolic::range(Polynomial(5), ranges), Range(5, 5, 5));
+    EXPECT_EQ(metadiff::symbolic::range(x, ranges), ranges[0]);
+    EXPECT_EQ(metadiff::symbolic::range(2 * x * y + 1, ranges), Range(5, 24577, 4097));
+    EXPECT_EQ(metadiff::symbolic::range(x - y, ranges), Range(-2, 4094, 1022));
+
+    // Variables without a range are at least 1 and bounds saturate instead of overflowing
+    auto z = Polynomial::variable(2);
+    auto unbounded = metadiff::symbolic::range(x * z, ranges);
+    EXPECT_EQ(unbounded.min, 1);
+    EXPECT_EQ(unbounded.max, std::numeric_limits<long long>::max());
+    EXPECT_EQ(unbounded.likely, 1024);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
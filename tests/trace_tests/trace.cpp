@@ -0,0 +1,63 @@
+//
+// Created by alex on 24/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "trace.h"
+
+namespace trace = metadiff::trace;
+
+TEST(Trace, DisabledRecordsNothing) {
+    trace::disable();
+    trace::clear();
+    {
+        trace::Span span("phase", "test");
+        EXPECT_FALSE(span.is_active());
+    }
+    EXPECT_EQ(trace::collector().events.size(), 0);
+}
+
+TEST(Trace, SpansAndArguments) {
+    trace::clear();
+    trace::enable();
+    {
+        trace::Span outer("outer", "test");
+        trace::Span inner("inner", "test");
+        inner.arg("graph", "a \"quoted\" name");
+        inner.finish();
+    }
+    trace::disable();
+    auto &events = trace::collector().events;
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[0].name, "inner");
+    EXPECT_EQ(events[1].name, "outer");
+    EXPECT_LE(events[1].start, events[0].start);
+    EXPECT_GE(events[1].start + events[1].duration, events[0].start + events[0].duration);
+    EXPECT_EQ(events[0].args.size(), 1);
+    EXPECT_EQ(trace::TraceCollector::escape(events[0].args[0].second), "a \\\"quoted\\\" name");
+    EXPECT_EQ(events[0].thread, events[1].thread);
+}
+
+TEST(Trace, WritesTraceEvents) {
+    trace::clear();
+    trace::enable();
+    {
+        trace::Span span("compile", "backend");
+    }
+    trace::disable();
+    char path[] = "/tmp/metadiff_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    close(fd);
+    ASSERT_TRUE(trace::write(path));
+    std::ifstream f(path);
+    std::string json((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\": \"compile\", \"cat\": \"backend\", \"ph\": \"X\""), std::string::npos);
+    std::remove(path);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}